@@ -0,0 +1,190 @@
+#include "HeaderAnalyzer.h"
+
+#include "../Config.h"
+#include "../Context.h"
+#include "../IncludeParser.h"
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+static std::string JsonString(const std::string& string)
+{
+    std::string escaped = "\"";
+    for (char symbol : string) {
+        if (symbol == '"' || symbol == '\\') {
+            escaped += '\\';
+            escaped += symbol;
+        } else if (static_cast<unsigned char>(symbol) < 0x20) {
+            std::stringstream code;
+            code << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(symbol);
+            escaped += code.str();
+        } else {
+            escaped += symbol;
+        }
+    }
+    return escaped + "\"";
+}
+
+void HeaderAnalyzer::collect(Context* context)
+{
+    if (!context->m_timestamps_loaded) {
+        context->fill_compile_times();
+    }
+    if (!context->m_header_index.built()) {
+        context->m_header_index.build(context->directory(), context->m_build.header_folders());
+    }
+
+    uint64_t units = 0;
+    uint64_t units_without_time = 0;
+    std::unordered_map<std::string, Header> headers {};
+    std::unordered_map<std::string, Lookup> lookups {};
+    std::unordered_map<std::string, std::vector<std::string>> global_includes {};
+
+    for (auto& file : context->collect_sources()) {
+        auto relative_source = std::filesystem::proximate(file, context->cwd()).lexically_normal().string();
+
+        uint64_t compile_time = 0;
+        auto recorded = context->m_compile_times.find(relative_source);
+        if (recorded != context->m_compile_times.end()) {
+            compile_time = recorded->second;
+        } else {
+            units_without_time++;
+        }
+        units++;
+
+        // the compiler searches HeaderFolders once per unit for every distinct global include
+        std::unordered_set<std::string> unit_includes {};
+        for (auto& dependency : context->dependencies(file)) {
+            auto path = (context->cwd() / dependency).lexically_normal().string();
+            if (dependency != relative_source) {
+                auto& header = headers[path];
+                header.units++;
+                header.compile_time += compile_time;
+            }
+
+            auto includes = global_includes.find(path);
+            if (includes == global_includes.end()) {
+                includes = global_includes.emplace(path, std::vector<std::string>()).first;
+                IncludeParser(path).run([&](const std::string& include, bool global) {
+                    if (global) {
+                        includes->second.push_back(include);
+                    }
+                });
+            }
+            unit_includes.insert(includes->second.begin(), includes->second.end());
+        }
+
+        for (auto& include : unit_includes) {
+            auto resolved = context->m_header_index.find(include);
+            auto resolved_path = resolved ? resolved->lexically_normal().string() : std::string();
+            auto& lookup = lookups[include + " " + resolved_path];
+            if (lookup.units == 0) {
+                lookup.include = include;
+                lookup.resolved = resolved ? resolved_path : "not found";
+                lookup.probes = context->m_header_index.probes(include);
+            }
+            lookup.units++;
+        }
+    }
+
+    auto _ = ScopedLocker(m_lock);
+    m_units += units;
+    m_units_without_time += units_without_time;
+    for (auto& [path, header] : headers) {
+        m_headers[path].units += header.units;
+        m_headers[path].compile_time += header.compile_time;
+    }
+    for (auto& [key, lookup] : lookups) {
+        auto& merged = m_lookups[key];
+        if (merged.units == 0) {
+            merged = lookup;
+        } else {
+            merged.units += lookup.units;
+        }
+    }
+}
+
+void HeaderAnalyzer::report(Context* root)
+{
+    auto _ = ScopedLocker(m_lock);
+
+    std::vector<std::pair<std::string, Header>> headers(m_headers.begin(), m_headers.end());
+    std::sort(headers.begin(), headers.end(), [](const auto& a, const auto& b) {
+        if (a.second.compile_time != b.second.compile_time) {
+            return a.second.compile_time > b.second.compile_time;
+        }
+        if (a.second.units != b.second.units) {
+            return a.second.units > b.second.units;
+        }
+        return a.first < b.first;
+    });
+
+    std::vector<Lookup> lookups {};
+    for (auto& [key, lookup] : m_lookups) {
+        lookups.push_back(lookup);
+    }
+    std::sort(lookups.begin(), lookups.end(), [](const Lookup& a, const Lookup& b) {
+        if (a.probes * a.units != b.probes * b.units) {
+            return a.probes * a.units > b.probes * b.units;
+        }
+        return a.include < b.include;
+    });
+
+    auto rows = static_cast<size_t>(std::max(Config::the().int_flag("top", DefaultRows), 0));
+    std::stringstream line;
+    line << std::fixed << std::setprecision(1);
+
+    Log(Color::Magenta, "Headers by rebuild cost:", m_units, "translation units,", m_units_without_time, "without a recorded compile time");
+    line << std::setw(12) << "Cost (s)" << std::setw(8) << "Units"
+         << "  Header";
+    Log(Color::Blue, line.str());
+    for (size_t at = 0; at < std::min(rows, headers.size()); at++) {
+        line.str("");
+        line << std::setw(12) << headers[at].second.compile_time / 1000.0 << std::setw(8) << headers[at].second.units << "  " << headers[at].first;
+        Log(Color::Green, line.str());
+    }
+
+    Log(Color::Magenta, "HeaderFolders lookups by folders searched:");
+    line.str("");
+    line << std::setw(12) << "Searches" << std::setw(8) << "Units" << std::setw(9) << "Folders"
+         << "  Include -> found in";
+    Log(Color::Blue, line.str());
+    for (size_t at = 0; at < std::min(rows, lookups.size()); at++) {
+        line.str("");
+        line << std::setw(12) << lookups[at].probes * lookups[at].units << std::setw(8) << lookups[at].units << std::setw(9) << lookups[at].probes
+             << "  " << lookups[at].include << " -> " << lookups[at].resolved;
+        Log(Color::Green, line.str());
+    }
+
+    auto report_path = std::filesystem::path(root->maca_path()) / ReportFile;
+    Finder::CreateDirectory(report_path.parent_path());
+    std::ofstream json(report_path, std::ofstream::out | std::ofstream::trunc);
+
+    json << "{\n  \"units\": " << m_units << ",\n  \"units_without_time\": " << m_units_without_time << ",\n  \"headers\": [";
+    for (size_t at = 0; at < headers.size(); at++) {
+        json << (at ? ",\n" : "\n") << "    { \"path\": " << JsonString(headers[at].first)
+             << ", \"units\": " << headers[at].second.units
+             << ", \"compile_time_ms\": " << headers[at].second.compile_time << " }";
+    }
+    json << "\n  ],\n  \"lookups\": [";
+    for (size_t at = 0; at < lookups.size(); at++) {
+        json << (at ? ",\n" : "\n") << "    { \"include\": " << JsonString(lookups[at].include)
+             << ", \"resolved\": " << JsonString(lookups[at].resolved)
+             << ", \"folders_searched\": " << lookups[at].probes
+             << ", \"units\": " << lookups[at].units
+             << ", \"searches\": " << lookups[at].probes * lookups[at].units << " }";
+    }
+    json << "\n  ]\n}\n";
+
+    Log(Color::Blue, "Report written to", report_path.string());
+
+    m_units = 0;
+    m_units_without_time = 0;
+    m_headers.clear();
+    m_lookups.clear();
+}
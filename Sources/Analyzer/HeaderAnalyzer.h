@@ -0,0 +1,59 @@
+/*
+ * HeaderAnalyzer ranks headers by what they cost incremental builds ("analyze headers"):
+ * every translation unit that transitively includes a header is rebuilt when it changes,
+ * so a header costs the recorded compile time of all of its includers.
+ * It also ranks the global includes by the HeaderFolders entries searched to resolve them.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class Context;
+
+class HeaderAnalyzer {
+public:
+    static constexpr auto ReportFile = "header-costs.json";
+    static constexpr int DefaultRows = 20;
+
+public:
+    static HeaderAnalyzer& the()
+    {
+        static auto instance = HeaderAnalyzer();
+        return instance;
+    }
+
+    // Adds the translation units of a context, called from the context's thread
+    void collect(Context* context);
+
+    // Prints the tables and writes the JSON report into the root's MacaBuild folder
+    void report(Context* root);
+
+private:
+    struct Header {
+        uint64_t units {};
+        uint64_t compile_time {};
+    };
+
+    struct Lookup {
+        std::string include {};
+        std::string resolved {};
+        uint64_t probes {};
+        uint64_t units {};
+    };
+
+private:
+    HeaderAnalyzer() = default;
+
+private:
+    SpinLock m_lock {};
+    uint64_t m_units {};
+    uint64_t m_units_without_time {};
+    std::unordered_map<std::string, Header> m_headers {};
+    // keyed by the resolved path as well, contexts may have different HeaderFolders
+    std::unordered_map<std::string, Lookup> m_lookups {};
+};
@@ -0,0 +1,153 @@
+#include "BenchRunner.h"
+
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Macabuilder compares modification times with the second its last build started at,
+// a build starting in the second files were written in would see them as modified
+static void WaitForNextSecond()
+{
+    auto now = std::chrono::system_clock::now();
+    auto next = std::chrono::ceil<std::chrono::seconds>(now);
+    std::this_thread::sleep_until(next + std::chrono::milliseconds(10));
+}
+
+static double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    auto middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double BenchRunner::build(size_t& units)
+{
+    auto log = m_directory / LogFile;
+    auto started = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        Log(Color::Red, "can't start Macabuilder");
+        exit(1);
+    }
+    if (pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || chdir(m_directory.c_str()) < 0) {
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        // nothing may come from the object cache, every scenario has to do the actual work
+        execl(m_macabuilder.c_str(), m_macabuilder.c_str(), "-cache~off", "Build", nullptr);
+        _exit(127);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        Log(Color::Red, "the build failed, its output is in", log.string());
+        exit(1);
+    }
+
+    // the output isn't a terminal, so every compiled source has its own line
+    units = 0;
+    std::ifstream output(log);
+    std::string line {};
+    while (std::getline(output, line)) {
+        if (line.find("Built") != std::string::npos) {
+            units++;
+        }
+    }
+    return milliseconds;
+}
+
+void BenchRunner::clean()
+{
+    std::error_code error {};
+    // the iterator is invalidated by a removal, so it's started over until nothing is left
+    for (bool removed = true; removed;) {
+        removed = false;
+        for (auto& entry : std::filesystem::recursive_directory_iterator(m_directory, error)) {
+            if (entry.is_directory() && entry.path().filename() == "MacaBuild") {
+                std::filesystem::remove_all(entry.path(), error);
+                removed = true;
+                break;
+            }
+        }
+    }
+}
+
+void BenchRunner::run(int runs)
+{
+    if (!std::filesystem::exists(m_macabuilder)) {
+        Log(Color::Red, "can't find Macabuilder at", m_macabuilder.string() + ", pass -macabuilder~<path>");
+        exit(1);
+    }
+
+    std::string original {};
+    {
+        std::ifstream header(m_touched_header);
+        std::stringstream content {};
+        content << header.rdbuf();
+        original = content.str();
+    }
+
+    std::vector<Scenario> scenarios { { .name = "full" }, { .name = "no-op" }, { .name = "touch-header" } };
+    for (int run = 0; run < runs; run++) {
+        clean();
+        WaitForNextSecond();
+        scenarios[0].milliseconds.push_back(build(scenarios[0].units));
+        scenarios[1].milliseconds.push_back(build(scenarios[1].units));
+
+        WaitForNextSecond();
+        std::ofstream(m_touched_header, std::ofstream::app) << "// touched " << run << "\n";
+        scenarios[2].milliseconds.push_back(build(scenarios[2].units));
+
+        Log(Color::Blue, "Run", run + 1, "of", runs, "done");
+    }
+
+    std::ofstream(m_touched_header, std::ofstream::trunc) << original;
+    report(scenarios);
+}
+
+void BenchRunner::report(const std::vector<Scenario>& scenarios)
+{
+    std::ostringstream json {};
+    json << "{\n  \"options\": {";
+    json << "\"libraries\": " << m_options.libraries << ", \"executables\": " << m_options.executables;
+    json << ", \"sources\": " << m_options.sources << ", \"headers\": " << m_options.headers;
+    json << ", \"depth\": " << m_options.depth << ", \"fanout\": " << m_options.fanout << ", \"lines\": " << m_options.lines;
+    json << ", \"compile_ms\": " << m_options.compile_ms << ", \"link_ms\": " << m_options.link_ms << ", \"archive_ms\": " << m_options.archive_ms;
+    json << ", \"seed\": " << m_options.seed << "},\n  \"scenarios\": {";
+
+    for (size_t at = 0; at < scenarios.size(); at++) {
+        auto& scenario = scenarios[at];
+        auto min = *std::min_element(scenario.milliseconds.begin(), scenario.milliseconds.end());
+        auto median = Median(scenario.milliseconds);
+
+        std::ostringstream line {};
+        line.precision(1);
+        line << std::fixed << min << " ms min, " << median << " ms median, " << scenario.units << " units compiled";
+        Log(Color::Green, scenario.name + ":", line.str());
+
+        json << (at ? "," : "") << "\n    \"" << scenario.name << "\": {\"min_ms\": " << min << ", \"median_ms\": " << median << ", \"units\": " << scenario.units << ", \"runs_ms\": [";
+        for (size_t run = 0; run < scenario.milliseconds.size(); run++) {
+            json << (run ? ", " : "") << scenario.milliseconds[run];
+        }
+        json << "]}";
+    }
+    json << "\n  }\n}\n";
+
+    auto results = m_directory / ResultsFile;
+    std::ofstream(results, std::ofstream::trunc) << json.str();
+    Log(Color::Magenta, "Results:", results.string());
+}
@@ -0,0 +1,48 @@
+/*
+ * BenchRunner times Macabuilder on a generated project: a full build from scratch,
+ * a no-op build and a build after touching a deep header. Every scenario is repeated,
+ * the minimum and the median are reported and written to bench-results.json.
+ */
+
+#pragma once
+
+#include "ProjectGenerator.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class BenchRunner {
+public:
+    static constexpr auto ResultsFile = "bench-results.json";
+    static constexpr auto LogFile = "bench.log";
+
+public:
+    BenchRunner(std::filesystem::path directory, std::filesystem::path macabuilder, const ProjectOptions& options, std::filesystem::path touched_header)
+        : m_directory(std::move(directory))
+        , m_macabuilder(std::move(macabuilder))
+        , m_options(options)
+        , m_touched_header(std::move(touched_header))
+    {
+    }
+
+    void run(int runs);
+
+private:
+    struct Scenario {
+        std::string name {};
+        std::vector<double> milliseconds {};
+        size_t units {};
+    };
+
+    // Runs a build and returns its wall time, "units" is the number of compiled sources
+    double build(size_t& units);
+    void clean();
+    void report(const std::vector<Scenario>& scenarios);
+
+private:
+    std::filesystem::path m_directory {};
+    std::filesystem::path m_macabuilder {};
+    ProjectOptions m_options {};
+    std::filesystem::path m_touched_header {};
+};
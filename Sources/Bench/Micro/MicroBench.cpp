@@ -0,0 +1,90 @@
+#include "MicroBench.h"
+
+#include "../../Utils/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+static std::atomic<size_t> s_allocated_bytes {};
+static std::atomic<size_t> s_allocations {};
+
+static void* CountedAllocate(size_t size)
+{
+    s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto pointer = malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+
+bool MicroBench::selected(const std::string& name) const
+{
+    if (m_filters.empty()) {
+        return true;
+    }
+    for (auto& filter : m_filters) {
+        if (name.find(filter) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MicroBench::begin_batch()
+{
+    m_allocated_bytes = s_allocated_bytes.load(std::memory_order_relaxed);
+    m_allocations = s_allocations.load(std::memory_order_relaxed);
+}
+
+void MicroBench::end_batch(const std::string& name, size_t ops, size_t input_bytes_per_op, std::chrono::steady_clock::duration elapsed)
+{
+    auto nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+    Result result { .name = name, .ops = ops };
+    result.ns_per_op = nanoseconds / ops;
+    result.bytes_per_op = double(s_allocated_bytes.load(std::memory_order_relaxed) - m_allocated_bytes) / ops;
+    result.allocations_per_op = double(s_allocations.load(std::memory_order_relaxed) - m_allocations) / ops;
+    if (input_bytes_per_op) {
+        result.mb_per_second = double(input_bytes_per_op) * ops / nanoseconds * 1e9 / (1024 * 1024);
+    }
+    m_results.push_back(result);
+    Log(Color::Blue, "Measured", name);
+}
+
+void MicroBench::report() const
+{
+    size_t name_width = 10;
+    for (auto& result : m_results) {
+        name_width = std::max(name_width, result.name.size());
+    }
+
+    std::ostringstream header {};
+    header << std::left << std::setw(name_width) << "benchmark" << std::right << std::setw(14) << "ns/op" << std::setw(14) << "B/op" << std::setw(12) << "allocs/op" << std::setw(12) << "MB/s" << std::setw(12) << "ops";
+    Log(Color::Magenta, header.str());
+
+    for (auto& result : m_results) {
+        std::ostringstream line {};
+        line << std::fixed << std::setprecision(1);
+        line << std::left << std::setw(name_width) << result.name << std::right;
+        line << std::setw(14) << result.ns_per_op << std::setw(14) << result.bytes_per_op << std::setw(12) << std::setprecision(2) << result.allocations_per_op;
+        line << std::setw(12) << std::setprecision(1);
+        if (result.mb_per_second) {
+            line << result.mb_per_second;
+        } else {
+            line << "-";
+        }
+        line << std::setw(12) << result.ops;
+        Log(Color::Green, line.str());
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * MicroBench times a single operation in isolation: the operation is repeated in growing
+ * batches until a batch lasts long enough, then the time and the heap allocations of that
+ * batch are divided by the operations it did. Allocations are counted by replacing the
+ * global operator new of the binary, so they include every thread.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class MicroBench {
+public:
+    struct Result {
+        std::string name {};
+        size_t ops {};
+        double ns_per_op {};
+        double bytes_per_op {};
+        double allocations_per_op {};
+        double mb_per_second {};
+    };
+
+public:
+    MicroBench(std::chrono::milliseconds min_time, std::vector<std::string> filters)
+        : m_min_time(min_time)
+        , m_filters(std::move(filters))
+    {
+    }
+
+    // A call of the operation does ops_per_call operations reading input_bytes_per_op bytes each, if known
+    template <typename Operation>
+    void measure(const std::string& name, size_t ops_per_call, size_t input_bytes_per_op, Operation operation)
+    {
+        if (!selected(name)) {
+            return;
+        }
+
+        // the first call fills the caches the later ones would find filled anyway
+        operation();
+
+        for (size_t calls = 1;; calls *= 2) {
+            begin_batch();
+            auto started = std::chrono::steady_clock::now();
+            for (size_t call = 0; call < calls; call++) {
+                operation();
+            }
+            auto elapsed = std::chrono::steady_clock::now() - started;
+            if (elapsed >= m_min_time || calls >= MaxCalls) {
+                end_batch(name, calls * ops_per_call, input_bytes_per_op, elapsed);
+                return;
+            }
+        }
+    }
+
+    bool selected(const std::string& name) const;
+    void report() const;
+
+private:
+    static constexpr size_t MaxCalls = size_t(1) << 30;
+
+    void begin_batch();
+    void end_batch(const std::string& name, size_t ops, size_t input_bytes_per_op, std::chrono::steady_clock::duration elapsed);
+
+private:
+    std::chrono::milliseconds m_min_time {};
+    std::vector<std::string> m_filters {};
+    std::vector<Result> m_results {};
+    size_t m_allocated_bytes {};
+    size_t m_allocations {};
+};
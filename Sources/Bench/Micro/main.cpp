@@ -0,0 +1,255 @@
+/*
+ * macabench-micro times the hot components of Macabuilder one by one on generated inputs:
+ *   macabench-micro [name filter...] [-key~value...]
+ * Every benchmark prints its time, heap bytes and allocations per operation.
+ */
+
+#include "../../Config.h"
+#include "../../Finder/Glob.h"
+#include "../../Finder/GlobCache.h"
+#include "../../Finder/StatCache.h"
+#include "../../IncludeParser.h"
+#include "../../Parser/Lexer/Lexer.h"
+#include "../../TimeStampDumper.h"
+#include "../../TimeStampParser.h"
+#include "../../Utils/Logger.h"
+#include "../../Utils/ThreadQueue.h"
+#include "../../Utils/Utils.h"
+#include "MicroBench.h"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+// Results are summed into it, so that the compiler can't drop the measured work
+static volatile size_t s_sink {};
+
+static void Keep(size_t value)
+{
+    s_sink = s_sink + value;
+}
+
+static size_t WriteFile(const std::filesystem::path& path, const std::string& content)
+{
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path, std::ofstream::trunc) << content;
+    return content.size();
+}
+
+// Defines, commands and a long Src list in the shape of the real files, repeated up to the size
+static size_t WriteMaca(const std::filesystem::path& path, size_t size)
+{
+    std::ostringstream maca {};
+    for (size_t block = 0; static_cast<size_t>(maca.tellp()) < size; block++) {
+        maca << "Define:\n";
+        maca << "    compiler" << block << ": g++\n";
+        maca << "    target~aarch32:\n        compiler" << block << ": arm-none-eabi-g++\n\n";
+        maca << "Commands:\n    Run" << block << ":\n";
+        maca << "        qemu-system-i386 -m 256 -kernel MacaBuild/kernel" << block << " -drive file\\~drive.img\\, format\\~raw,\n";
+        maca << "        {compiler" << block << "} -o MacaBuild/tool" << block << " tool.cpp\n\n";
+        maca << "Build:\n    Type: Executable\n\n    Src:\n";
+        for (int pattern = 0; pattern < 16; pattern++) {
+            maca << "        folder" << block << "/module" << pattern << "/**/*.cpp,\n";
+        }
+        maca << "        !folder" << block << "/third_party/**\n\n";
+        maca << "    Extensions:\n        cpp:\n            Compiler: {compiler" << block << "}\n";
+        maca << "            Flags: -std=c++2a, -O2, -fno-rtti, -fno-exceptions, -Wall, -Iinclude\n\n";
+    }
+    return WriteFile(path, maca.str());
+}
+
+static size_t WriteTree(const std::filesystem::path& root, int folders, int files)
+{
+    size_t written = 0;
+    for (int folder = 0; folder < folders; folder++) {
+        for (int subfolder = 0; subfolder < folders; subfolder++) {
+            auto directory = root / ("module" + std::to_string(folder)) / ("part" + std::to_string(subfolder));
+            for (int file = 0; file < files; file++) {
+                WriteFile(directory / ("file" + std::to_string(file) + (file % 2 ? ".h" : ".cpp")), "");
+                written++;
+            }
+        }
+    }
+    return written;
+}
+
+// Compact headers start with their includes right after "#pragma once". Guarded ones are written the way
+// most projects do: a license comment, an include guard, and comments and a macro between the includes.
+static void WriteHeaders(const std::filesystem::path& root, int headers, int includes, int lines, bool guarded)
+{
+    static constexpr const char* SystemHeaders[] = { "vector", "string", "memory", "unordered_map", "filesystem", "functional" };
+    for (int header = 0; header < headers; header++) {
+        std::ostringstream file {};
+        auto guard = "MODULE_HEADER" + std::to_string(header) + "_H";
+        if (guarded) {
+            file << "/*\n * Copyright (c) 2024, The Module Authors.\n *\n";
+            for (int line = 0; line < 12; line++) {
+                file << " * Licensed under the terms of the license found in the LICENSE file, line " << line << ".\n";
+            }
+            file << " */\n\n#ifndef " << guard << "\n#define " << guard << "\n\n";
+        } else {
+            file << "#pragma once\n\n";
+        }
+        for (int include = 0; include < includes; include++) {
+            if (guarded && include % 4 == 0) {
+                file << "\n// Dependencies of part " << include / 4 << "\n";
+            }
+            if (guarded && include == includes / 2) {
+                file << "#define MODULE_HEADER" << header << "_EXPORT __attribute__((visibility(\"default\")))\n";
+            }
+            if (include % 3 == 0) {
+                file << "#include <" << SystemHeaders[include % std::size(SystemHeaders)] << ">\n";
+            } else {
+                file << "#include \"../Module" << include << "/Header" << (header + include) % headers << ".h\"\n";
+            }
+        }
+        file << "\n";
+        for (int line = 0; line < lines; line++) {
+            file << "int header" << header << "_declaration" << line << "(int value);\n";
+        }
+        if (guarded) {
+            file << "\n#endif // " << guard << "\n";
+        }
+        WriteFile(root / ("Header" + std::to_string(header) + ".h"), file.str());
+    }
+}
+
+static void LexerBenchmarks(MicroBench& bench, const std::filesystem::path& directory)
+{
+    auto path = (directory / "large.maca").string();
+    auto size = WriteMaca(path, static_cast<size_t>(std::max(Config::the().int_flag("maca-kb", 1024), 1)) * 1024);
+    bench.measure("Lexer::run, " + std::to_string(size / 1024) + " KiB .maca", 1, size, [&] {
+        auto arena = Arena();
+        auto lexer = Lexer(path, arena);
+        lexer.run();
+        Keep(lexer.tokens().size());
+    });
+}
+
+static void GlobBenchmarks(MicroBench& bench, const std::filesystem::path& directory)
+{
+    auto root = directory / "tree";
+    auto files = WriteTree(root, 8, 16);
+    auto pattern = (root / "**/*.cpp").string();
+    // a new build: listings are revalidated by their directories' mtimes, stats are made again
+    bench.measure("Glob, **/*.cpp minus an exclusion, " + std::to_string(files) + " files", 1, 0, [&] {
+        StatCache::the().clear();
+        GlobCache::the().revalidate();
+        Keep(Glob(pattern, { (root / "*/part0/**").string() }).result().size());
+    });
+}
+
+static void IncludeParserBenchmarks(MicroBench& bench, const std::filesystem::path& directory)
+{
+    static constexpr int Headers = 64;
+    for (bool guarded : { false, true }) {
+        auto root = directory / (guarded ? "guarded-headers" : "headers");
+        WriteHeaders(root, Headers, 12, 200, guarded);
+        std::vector<std::filesystem::path> headers {};
+        size_t bytes = 0;
+        for (int header = 0; header < Headers; header++) {
+            headers.push_back(root / ("Header" + std::to_string(header) + ".h"));
+            bytes += std::filesystem::file_size(headers.back());
+        }
+        auto label = guarded ? "IncludeParser::run, per header with a license and include guards" : "IncludeParser::run, per header with #pragma once";
+        bench.measure(label, Headers, bytes / Headers, [&] {
+            for (auto& header : headers) {
+                IncludeParser(header).run([&](const std::string& include, bool global) {
+                    Keep(include.size() + global);
+                });
+            }
+        });
+    }
+}
+
+static void TimeStampBenchmarks(MicroBench& bench, const std::filesystem::path& directory)
+{
+    auto entries = static_cast<size_t>(std::max(Config::the().int_flag("entries", 100000), 1));
+    std::vector<std::string> paths {};
+    size_t bytes = 0;
+    for (size_t entry = 0; entry < entries; entry++) {
+        paths.push_back("Sources/Module" + std::to_string(entry % 97) + "/Part" + std::to_string(entry % 13) + "/File" + std::to_string(entry) + ".cpp");
+        bytes += paths.back().size() + 12;
+    }
+    auto path = directory / "timestamps.macainfo";
+    auto label = ", per entry of " + std::to_string(entries);
+
+    bench.measure("TimeStampDumper::append" + label, entries, bytes / entries, [&] {
+        auto dumper = TimeStampDumper(path);
+        for (size_t entry = 0; entry < entries; entry++) {
+            dumper.append(paths[entry], 1700000000 + static_cast<int>(entry));
+        }
+    });
+    bench.measure("TimeStampParser::run" + label, entries, bytes / entries, [&] {
+        TimeStampParser(path).run([&](const std::string& path, int timestamp) {
+            Keep(path.size() + timestamp);
+        });
+    });
+}
+
+// Every thread pushes and pops the units' shared pointers, as the executor's slots do
+static void ThreadQueueBenchmarks(MicroBench& bench)
+{
+    static constexpr size_t PairsPerThread = 10000;
+    auto threads = static_cast<size_t>(std::max(Config::the().int_flag("threads", static_cast<int>(std::max(std::thread::hardware_concurrency(), 2u))), 1));
+    auto queue = ThreadQueue<std::shared_ptr<size_t>>();
+    auto unit = std::make_shared<size_t>(1);
+
+    bench.measure("ThreadQueue, " + std::to_string(threads) + " threads, per enqueue+dequeue", threads * PairsPerThread, 0, [&] {
+        std::vector<std::thread> workers {};
+        for (size_t thread = 0; thread < threads; thread++) {
+            workers.emplace_back([&] {
+                std::shared_ptr<size_t> taken {};
+                size_t taken_count = 0;
+                for (size_t pair = 0; pair < PairsPerThread; pair++) {
+                    queue.enqueue(unit);
+                    taken_count += queue.dequeue(taken);
+                }
+                Keep(taken_count);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    });
+}
+
+static void SplitBenchmarks(MicroBench& bench)
+{
+    std::string path = "Sources/Parser/Lexer/Generated/Module/Part/Token.h";
+    bench.measure("Utils::Split, 7 part path", 1, path.size(), [&] {
+        Keep(Utils::Split(path, "/").size());
+    });
+
+    std::string headers = "PUT /0123456789abcdef HTTP/1.1\r\nHost: 127.0.0.1:8484\r\nContent-Type: application/octet-stream\r\nContent-Length: 65536\r\nConnection: close";
+    bench.measure("Utils::Split, http header", 1, headers.size(), [&] {
+        Keep(Utils::Split(headers, "\r\n").size());
+    });
+}
+
+int main(int argc, char** argv)
+{
+    Config::the().process_arguments(argc, argv);
+
+    auto& flags = Config::the().flags();
+    bool keep = flags.contains("dir") && !flags["dir"].empty();
+    auto directory = keep ? std::filesystem::absolute(flags["dir"]) : std::filesystem::temp_directory_path() / ("macabench-micro-" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+
+    auto bench = MicroBench(std::chrono::milliseconds(std::max(Config::the().int_flag("min-ms", 500), 1)), Config::the().arguments());
+    LexerBenchmarks(bench, directory);
+    GlobBenchmarks(bench, directory);
+    IncludeParserBenchmarks(bench, directory);
+    TimeStampBenchmarks(bench, directory);
+    ThreadQueueBenchmarks(bench);
+    SplitBenchmarks(bench);
+    bench.report();
+
+    if (!keep) {
+        std::error_code error {};
+        std::filesystem::remove_all(directory, error);
+    }
+    return 0;
+}
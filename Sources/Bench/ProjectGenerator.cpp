@@ -0,0 +1,183 @@
+#include "ProjectGenerator.h"
+
+#include "../Config.h"
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+static constexpr auto RootTarget = "bench";
+
+// Files are only rewritten when they differ, so generating the same project again keeps its timestamps
+static void WriteIfChanged(const std::filesystem::path& path, const std::string& content)
+{
+    std::ifstream previous(path);
+    std::stringstream previous_content {};
+    previous_content << previous.rdbuf();
+    if (previous && previous_content.str() == content) {
+        return;
+    }
+    std::ofstream(path, std::ofstream::trunc) << content;
+}
+
+static std::string HeaderName(const std::string& target, int header)
+{
+    return target + "_h" + std::to_string(header) + ".h";
+}
+
+ProjectOptions ProjectOptions::FromFlags()
+{
+    auto& config = Config::the();
+    ProjectOptions options {};
+    options.libraries = std::max(config.int_flag("libraries", options.libraries), 0);
+    options.executables = std::max(config.int_flag("executables", options.executables), 0);
+    options.sources = std::max(config.int_flag("sources", options.sources), 1);
+    options.headers = std::max(config.int_flag("headers", options.headers), 1);
+    options.depth = std::clamp(config.int_flag("depth", options.depth), 1, options.headers);
+    options.fanout = std::max(config.int_flag("fanout", options.fanout), 0);
+    options.lines = std::max(config.int_flag("lines", options.lines), 0);
+    options.compile_ms = std::max(config.int_flag("compile-ms", options.compile_ms), 0);
+    options.link_ms = std::max(config.int_flag("link-ms", options.link_ms), 0);
+    options.archive_ms = std::max(config.int_flag("archive-ms", options.archive_ms), 0);
+    options.seed = static_cast<uint64_t>(std::max(config.int_flag("seed", static_cast<int>(options.seed)), 0));
+    return options;
+}
+
+// splitmix64, the layout mustn't depend on the standard library's generators
+uint64_t ProjectGenerator::random()
+{
+    uint64_t value = (m_state += 0x9e3779b97f4a7c15);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+void ProjectGenerator::run()
+{
+    m_state = m_options.seed;
+    std::filesystem::create_directories(m_directory);
+    write_tools();
+
+    std::vector<std::string> libraries {};
+    for (int library = 0; library < m_options.libraries; library++) {
+        libraries.push_back("lib" + std::to_string(library));
+        write_target(libraries.back(), true, {});
+    }
+
+    // executables are built along with the root, the libraries are linked into all of them
+    std::vector<std::string> sibling_libraries {};
+    for (auto& library : libraries) {
+        sibling_libraries.push_back("../" + library);
+    }
+    std::vector<std::string> root_depends = libraries;
+    for (int executable = 0; executable < m_options.executables; executable++) {
+        root_depends.push_back("app" + std::to_string(executable));
+        write_target(root_depends.back(), false, sibling_libraries);
+    }
+    write_target(RootTarget, false, root_depends);
+
+    int targets = m_options.libraries + m_options.executables + 1;
+    Log(Color::Magenta, "Generated:", m_directory.string() + ",", targets, "targets,", targets * m_options.sources, "sources,", targets * m_options.headers, "headers");
+}
+
+std::filesystem::path ProjectGenerator::touched_header() const
+{
+    auto target = m_options.libraries ? std::string("lib0") : std::string(RootTarget);
+    auto folder = m_options.libraries ? m_directory / target : m_directory;
+    auto deepest = (m_options.depth - 1) * m_options.headers / m_options.depth;
+    return folder / "include" / HeaderName(target, deepest);
+}
+
+// The tools are links to macabench itself, it acts as them by the name it's run with
+void ProjectGenerator::write_tools()
+{
+    auto tools = m_directory / "tools";
+    std::filesystem::create_directories(tools);
+
+    std::error_code error {};
+    auto executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (error) {
+        Log(Color::Red, "can't find the macabench executable:", error.message());
+        exit(1);
+    }
+    for (auto tool : { "cc", "ld", "ar" }) {
+        auto link = tools / tool;
+        if (std::filesystem::read_symlink(link, error) != executable) {
+            std::filesystem::remove(link, error);
+            std::filesystem::create_symlink(executable, link);
+        }
+    }
+
+    WriteIfChanged(tools / "delays", std::to_string(m_options.compile_ms) + " " + std::to_string(m_options.link_ms) + " " + std::to_string(m_options.archive_ms) + "\n");
+}
+
+void ProjectGenerator::write_target(const std::string& name, bool library, const std::vector<std::string>& depends)
+{
+    bool root = name == RootTarget;
+    auto folder = root ? m_directory : m_directory / name;
+    std::filesystem::create_directories(folder / "include");
+    std::filesystem::create_directories(folder / "src");
+
+    // headers are split into levels, each one including headers of the next level only
+    auto level_begin = [&](int level) { return level * m_options.headers / m_options.depth; };
+    auto pick_includes = [&](std::ostream& file, int level, const std::string& prefix) {
+        int begin = level_begin(level);
+        int end = level_begin(level + 1);
+        for (int include = 0; include < m_options.fanout && end > begin; include++) {
+            file << "#include \"" << prefix << HeaderName(name, begin + static_cast<int>(random() % (end - begin))) << "\"\n";
+        }
+    };
+
+    for (int level = 0; level < m_options.depth; level++) {
+        for (int header = level_begin(level); header < level_begin(level + 1); header++) {
+            std::ostringstream file {};
+            file << "#pragma once\n\n";
+            if (level + 1 < m_options.depth) {
+                pick_includes(file, level + 1, "");
+            }
+            file << "\n";
+            for (int line = 0; line < m_options.lines; line++) {
+                file << "int " << name << "_h" << header << "_declaration" << line << "(int value);\n";
+            }
+            WriteIfChanged(folder / "include" / HeaderName(name, header), file.str());
+        }
+    }
+
+    for (int source = 0; source < m_options.sources; source++) {
+        std::ostringstream file {};
+        pick_includes(file, 0, "../include/");
+        file << "\n";
+        for (int line = 0; line < m_options.lines; line++) {
+            file << "int " << name << "_s" << source << "_definition" << line << "(int value) { return value + " << line << "; }\n";
+        }
+        WriteIfChanged(folder / "src" / (name + "_s" + std::to_string(source) + ".c"), file.str());
+    }
+
+    auto tools = std::filesystem::absolute(m_directory / "tools").lexically_normal().string();
+    if (tools.find_first_of(" ,:~{}") != std::string::npos) {
+        Log(Color::Red, "the benchmark folder can't be written into a .maca file:", tools);
+        exit(1);
+    }
+
+    std::ostringstream maca {};
+    maca << "Build:\n";
+    maca << "    Type: " << (library ? "StaticLib" : "Executable") << "\n\n";
+    if (!depends.empty()) {
+        maca << "    Depends:\n        ";
+        for (size_t at = 0; at < depends.size(); at++) {
+            maca << (at ? ", " : "") << depends[at];
+        }
+        maca << "\n\n";
+    }
+    maca << "    Src:\n        src/*.c\n\n";
+    maca << "    Extensions:\n        c:\n            Compiler: " << tools << "/cc\n\n";
+    if (library) {
+        maca << "    Archiver: " << tools << "/ar\n";
+    } else {
+        maca << "    Link:\n        Linker: " << tools << "/ld\n";
+    }
+    WriteIfChanged(folder / (name + ".maca"), maca.str());
+}
@@ -0,0 +1,54 @@
+/*
+ * ProjectGenerator writes a synthetic project for the benchmarks: StaticLib and Executable
+ * .maca files joined through Depends, each with its sources and a layered header graph.
+ * Compilers, the linker and the archiver are fake tools sleeping for a configured time,
+ * so the build measures Macabuilder rather than the compilers. The same options and seed
+ * always give the same project.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct ProjectOptions {
+    int libraries { 4 };
+    int executables { 2 };
+    int sources { 40 };
+    int headers { 24 };
+    int depth { 4 };
+    int fanout { 3 };
+    int lines { 40 };
+    int compile_ms { 20 };
+    int link_ms { 40 };
+    int archive_ms { 10 };
+    uint64_t seed { 1 };
+
+    static ProjectOptions FromFlags();
+};
+
+class ProjectGenerator {
+public:
+    ProjectGenerator(std::filesystem::path directory, const ProjectOptions& options)
+        : m_directory(std::move(directory))
+        , m_options(options)
+    {
+    }
+
+    void run();
+
+    // The header the incremental benchmark touches: the deepest level of the first target, included by most of its sources
+    std::filesystem::path touched_header() const;
+
+private:
+    void write_tools();
+    void write_target(const std::string& name, bool library, const std::vector<std::string>& depends);
+    uint64_t random();
+
+private:
+    std::filesystem::path m_directory {};
+    ProjectOptions m_options {};
+    uint64_t m_state {};
+};
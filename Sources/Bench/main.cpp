@@ -0,0 +1,93 @@
+/*
+ * macabench generates a synthetic project and times Macabuilder building it:
+ *   macabench [generate | run] <directory> [-key~value...]
+ * Run as "cc", "ld" or "ar" (the links in the project's tools folder) it is the fake
+ * compiler, linker or archiver: it sleeps for the configured time and writes its output.
+ */
+
+#include "../Config.h"
+#include "../Utils/Logger.h"
+#include "BenchRunner.h"
+#include "ProjectGenerator.h"
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+static int FakeTool(const std::string& tool, int argc, char** argv)
+{
+    int compile_ms = 0;
+    int link_ms = 0;
+    int archive_ms = 0;
+    std::ifstream(std::filesystem::path(argv[0]).parent_path() / "delays") >> compile_ms >> link_ms >> archive_ms;
+
+    // ar takes the archive after the operation, the others take -o
+    std::string output {};
+    int delay = archive_ms;
+    if (tool == "ar") {
+        output = argc > 2 ? argv[2] : "";
+    } else {
+        delay = tool == "cc" ? compile_ms : link_ms;
+        for (int at = 1; at + 1 < argc; at++) {
+            if (std::string(argv[at]) == "-o") {
+                output = argv[at + 1];
+            }
+        }
+    }
+    if (output.empty()) {
+        fprintf(stderr, "%s: no output given\n", tool.c_str());
+        return 1;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+    // the command line is the whole content, so an unchanged unit writes the same output
+    std::ofstream file(output, std::ofstream::trunc);
+    for (int at = 1; at < argc; at++) {
+        file << argv[at] << "\n";
+    }
+    return file ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    auto tool = std::filesystem::path(argv[0]).filename().string();
+    if (tool == "cc" || tool == "ld" || tool == "ar") {
+        return FakeTool(tool, argc, argv);
+    }
+
+    Config::the().process_arguments(argc, argv);
+    auto& arguments = Config::the().arguments();
+
+    bool generate = true;
+    bool run = true;
+    size_t directory_at = 0;
+    if (!arguments.empty() && (arguments[0] == "generate" || arguments[0] == "run")) {
+        generate = arguments[0] == "generate";
+        run = arguments[0] == "run";
+        directory_at = 1;
+    }
+    if (arguments.size() != directory_at + 1) {
+        Log(Color::Red, "usage: macabench [generate | run] <directory> [-key~value...]");
+        exit(1);
+    }
+
+    auto directory = std::filesystem::absolute(arguments[directory_at]).lexically_normal();
+    auto options = ProjectOptions::FromFlags();
+    auto generator = ProjectGenerator(directory, options);
+    if (generate) {
+        generator.run();
+    }
+
+    if (run) {
+        // built next to macabench by default
+        std::error_code error {};
+        auto macabuilder = std::filesystem::read_symlink("/proc/self/exe", error).parent_path() / "Macabuilder";
+        auto flag = Config::the().flags().find("macabuilder");
+        if (flag != Config::the().flags().end() && !flag->second.empty()) {
+            macabuilder = std::filesystem::absolute(flag->second);
+        }
+        BenchRunner(directory, macabuilder, options, generator.touched_header()).run(std::max(Config::the().int_flag("runs", 3), 1));
+    }
+    return 0;
+}
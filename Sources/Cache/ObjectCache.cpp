@@ -0,0 +1,745 @@
+#include "ObjectCache.h"
+#include "../Config.h"
+#include "../Utils/Compression.h"
+#include "../Utils/Hash.h"
+#include "../Utils/Logger.h"
+#include "../Utils/Utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Layout of an entry: header, stdout, stderr, object (compressed unless it didn't shrink)
+struct EntryHeader {
+    char magic[4] { 'M', 'O', 'C', '1' };
+    uint32_t compressed {};
+    uint64_t object_size {};
+    uint64_t payload_size {};
+    uint64_t cpu_time {};
+    uint32_t out_size {};
+    uint32_t err_size {};
+};
+
+bool ValidHeader(const EntryHeader& header, uint64_t file_size)
+{
+    return !memcmp(header.magic, EntryHeader().magic, sizeof(header.magic))
+        && sizeof(EntryHeader) + header.out_size + header.err_size + header.payload_size == file_size;
+}
+
+// Writes the object of an entry to "object", which is replaced by a new file
+bool DecodeEntry(const std::string& content, const std::filesystem::path& object, CacheEntry& entry, EntryHeader& header)
+{
+    if (content.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, content.data(), sizeof(header));
+    if (!ValidHeader(header, content.size())) {
+        return false;
+    }
+
+    auto at = content.data() + sizeof(header);
+    entry.std_out.assign(at, header.out_size);
+    at += header.out_size;
+    entry.std_err.assign(at, header.err_size);
+    at += header.err_size;
+
+    std::string object_content(header.object_size, '\0');
+    if (header.compressed) {
+        if (!Compression::Decompress(at, header.payload_size, object_content.data(), object_content.size())) {
+            return false;
+        }
+    } else {
+        memcpy(object_content.data(), at, object_content.size());
+    }
+
+    // a fresh file, the old one might still be read by an archiver
+    unlink(object.c_str());
+    int fd = open(object.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = Utils::WriteAll(fd, object_content.data(), object_content.size());
+    close(fd);
+    if (!written) {
+        unlink(object.c_str());
+    }
+    return written;
+}
+
+std::string FormatBytes(uint64_t bytes)
+{
+    static constexpr const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double value = bytes;
+    size_t unit = 0;
+    while (value >= 1024 && unit + 1 < std::size(units)) {
+        value /= 1024;
+        unit++;
+    }
+
+    std::stringstream formatted;
+    formatted << std::fixed << std::setprecision(unit ? 1 : 0) << value << " " << units[unit];
+    return formatted.str();
+}
+
+}
+
+bool ObjectCache::enabled() const
+{
+    auto& flags = Config::the().flags();
+    auto flag = flags.find("cache");
+    if (flag != flags.end()) {
+        return flag->second != "off";
+    }
+    return flags.contains("remote-cache");
+}
+
+std::filesystem::path ObjectCache::directory() const
+{
+    auto flag = Config::the().flags().find("cache");
+    if (flag != Config::the().flags().end() && !flag->second.empty() && flag->second != "on" && flag->second != "off") {
+        return flag->second;
+    }
+
+    if (auto cache_home = getenv("XDG_CACHE_HOME"); cache_home && *cache_home) {
+        return std::filesystem::path(cache_home) / "macabuild";
+    }
+    if (auto home = getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "macabuild";
+    }
+    return std::filesystem::temp_directory_path() / "macabuild";
+}
+
+uint64_t ObjectCache::size_limit() const
+{
+    return static_cast<uint64_t>(Config::the().int_flag("cache-size", 5120)) << 20;
+}
+
+uint64_t ObjectCache::compiler_fingerprint(const std::string& compiler)
+{
+    {
+        auto _ = ScopedLocker(m_lock);
+        auto fingerprint = m_fingerprints.find(compiler);
+        if (fingerprint != m_fingerprints.end()) {
+            return fingerprint->second;
+        }
+    }
+
+    // resolve the compiler the way execvp does
+    std::filesystem::path binary = compiler;
+    if (compiler.find('/') == std::string::npos) {
+        if (auto path = getenv("PATH")) {
+            for (auto& folder : Utils::Split(path, ":")) {
+                auto candidate = std::filesystem::path(folder.empty() ? "." : folder) / compiler;
+                if (access(candidate.c_str(), X_OK) == 0) {
+                    binary = candidate;
+                    break;
+                }
+            }
+        }
+    }
+
+    uint64_t fingerprint = Hash::String(compiler);
+    char resolved_path[PATH_MAX];
+    struct stat binary_stat {};
+    if (realpath(binary.c_str(), resolved_path) && stat(resolved_path, &binary_stat) == 0) {
+        fingerprint = Hash::String(resolved_path, fingerprint);
+        fingerprint = Hash::Combine(fingerprint, binary_stat.st_size);
+        fingerprint = Hash::Combine(fingerprint, binary_stat.st_mtim.tv_sec);
+        fingerprint = Hash::Combine(fingerprint, binary_stat.st_mtim.tv_nsec);
+    }
+
+    auto _ = ScopedLocker(m_lock);
+    m_fingerprints[compiler] = fingerprint;
+    return fingerprint;
+}
+
+std::filesystem::path ObjectCache::entry_path(uint64_t key) const
+{
+    auto hex = Hash::ToHex(key);
+    return directory() / hex.substr(0, 2) / (hex.substr(2) + EntryExtension);
+}
+
+std::optional<ObjectCache::Entry> ObjectCache::fetch(uint64_t key, const std::filesystem::path& object)
+{
+    auto path = entry_path(key);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+
+    struct stat entry_stat {};
+    std::string content {};
+    if (fstat(fd, &entry_stat) == 0) {
+        content.resize(entry_stat.st_size);
+    }
+    bool read = Utils::ReadAll(fd, content.data(), content.size());
+    close(fd);
+
+    Entry entry {};
+    EntryHeader header {};
+    if (!read || !DecodeEntry(content, object, entry, header)) {
+        unlink(path.c_str());
+        return {};
+    }
+
+    // the modification time tells the eviction which entries were used last
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+    {
+        auto _ = std::lock_guard(m_mutex);
+        m_delta.hits++;
+        m_delta.cpu_time_saved += header.cpu_time;
+        m_delta.bytes_served += header.object_size;
+        m_delta_dirty = true;
+    }
+    wake_writer();
+
+    return entry;
+}
+
+void ObjectCache::store(uint64_t key, const std::filesystem::path& object, const std::string& std_out, const std::string& std_err, uint64_t cpu_time)
+{
+    // objects are unlinked before compiling, so the descriptor keeps this very content
+    int fd = open(object.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    // a compiled object is stored after its lookups missed
+    {
+        auto _ = std::lock_guard(m_mutex);
+        m_delta.misses++;
+        m_delta_dirty = true;
+        m_pending.push_back(PendingEntry {
+            .key = key,
+            .object_fd = fd,
+            .std_out = std_out,
+            .std_err = std_err,
+            .cpu_time = cpu_time,
+        });
+    }
+    wake_writer();
+}
+
+void ObjectCache::wake_writer()
+{
+    auto _ = std::lock_guard(m_mutex);
+    if (!m_writer) {
+        m_writer = new std::thread([this]() { run_writer(); });
+    }
+    m_wakeup.notify_one();
+}
+
+void ObjectCache::flush()
+{
+    {
+        auto _ = std::lock_guard(m_mutex);
+        if (!m_writer) {
+            if (!m_delta_dirty && m_downloaders.empty()) {
+                return;
+            }
+            m_writer = new std::thread([this]() { run_writer(); });
+        }
+        m_stopping = true;
+        m_wakeup.notify_one();
+    }
+
+    m_download_wakeup.notify_all();
+    m_writer->join();
+    for (auto downloader : m_downloaders) {
+        downloader->join();
+        delete downloader;
+    }
+
+    auto _ = std::lock_guard(m_mutex);
+    delete m_writer;
+    m_writer = nullptr;
+    m_downloaders.clear();
+    m_downloads.clear();
+    m_stopping = false;
+}
+
+void ObjectCache::run_writer()
+{
+    auto lock = std::unique_lock(m_mutex);
+
+    while (true) {
+        m_wakeup.wait(lock, [this]() { return !m_pending.empty() || m_delta_dirty || m_stopping; });
+
+        while (!m_pending.empty()) {
+            auto pending = std::move(m_pending.front());
+            m_pending.pop_front();
+
+            lock.unlock();
+            Stats delta {};
+            std::string content {};
+            bool written = write_entry(pending, delta, content);
+            close(pending.object_fd);
+            if (written) {
+                upload(pending.key, content);
+            }
+            lock.lock();
+
+            if (written) {
+                m_delta.entries += delta.entries;
+                m_delta.object_bytes += delta.object_bytes;
+                m_delta.stored_bytes += delta.stored_bytes;
+                m_delta_dirty = true;
+            }
+        }
+
+        if (m_delta_dirty) {
+            auto delta = m_delta;
+            m_delta = {};
+            m_delta_dirty = false;
+
+            lock.unlock();
+            auto total = merge_stats(delta);
+            if (total.stored_bytes > size_limit()) {
+                evict();
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (m_stopping) {
+            return;
+        }
+    }
+}
+
+bool ObjectCache::write_entry(const PendingEntry& pending, Stats& delta, std::string& content)
+{
+    struct stat object_stat {};
+    if (fstat(pending.object_fd, &object_stat) < 0) {
+        return false;
+    }
+    std::string object_content(object_stat.st_size, '\0');
+    if (!Utils::ReadAll(pending.object_fd, object_content.data(), object_content.size())) {
+        return false;
+    }
+
+    EntryHeader header {};
+    header.object_size = object_content.size();
+    header.cpu_time = pending.cpu_time;
+    header.out_size = pending.std_out.size();
+    header.err_size = pending.std_err.size();
+
+    auto compressed = Compression::Compress(object_content.data(), object_content.size());
+    std::string& payload = compressed.size() < object_content.size() ? compressed : object_content;
+    header.compressed = &payload == &compressed;
+    header.payload_size = payload.size();
+
+    content.clear();
+    content.reserve(sizeof(header) + header.out_size + header.err_size + header.payload_size);
+    content.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    content.append(pending.std_out);
+    content.append(pending.std_err);
+    content.append(payload);
+
+    if (!write_file(entry_path(pending.key), content)) {
+        return false;
+    }
+
+    delta.entries = 1;
+    delta.object_bytes = header.object_size;
+    delta.stored_bytes = content.size();
+    return true;
+}
+
+// Entries are renamed into place, so concurrent builds never see half-written files
+bool ObjectCache::write_file(const std::filesystem::path& path, const std::string& content)
+{
+    std::error_code error {};
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    auto temporary = std::filesystem::path(path).concat(".tmp." + std::to_string(getpid()) + "." + std::to_string(gettid()));
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = Utils::WriteAll(fd, content.data(), content.size());
+    close(fd);
+
+    if (!written || rename(temporary.c_str(), path.c_str()) < 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<Http::Url> ObjectCache::remote() const
+{
+    auto flag = Config::the().flags().find("remote-cache");
+    if (flag == Config::the().flags().end() || m_remote_unreachable) {
+        return {};
+    }
+    return Http::ParseUrl(flag->second);
+}
+
+void ObjectCache::remote_failed()
+{
+    // an unreachable remote cache would slow down every compilation
+    if (!m_remote_unreachable.exchange(true)) {
+        Log(Color::Yellow, "Remote cache is unreachable, using the local cache only");
+    }
+}
+
+std::shared_ptr<RemoteFetch> ObjectCache::fetch_remote(uint64_t key, const std::filesystem::path& object)
+{
+    if (!remote()) {
+        return nullptr;
+    }
+
+    auto fetch = std::make_shared<RemoteFetch>();
+    fetch->key = key;
+    fetch->object = object;
+    fetch->temporary = std::filesystem::path(object).concat(".remote");
+
+    auto _ = std::lock_guard(m_mutex);
+    auto downloaders = static_cast<size_t>(std::max(1, Config::the().int_flag("remote-downloads", 4)));
+    while (m_downloaders.size() < downloaders) {
+        m_downloaders.push_back(new std::thread([this]() { run_downloader(); }));
+    }
+    m_downloads.push_back(fetch);
+    m_download_wakeup.notify_one();
+    return fetch;
+}
+
+void ObjectCache::run_downloader()
+{
+    auto lock = std::unique_lock(m_mutex);
+
+    while (true) {
+        m_download_wakeup.wait(lock, [this]() { return !m_downloads.empty() || m_stopping; });
+        if (m_stopping) {
+            return;
+        }
+
+        auto fetch = std::move(m_downloads.front());
+        m_downloads.pop_front();
+
+        lock.unlock();
+        download(*fetch);
+        lock.lock();
+    }
+}
+
+void ObjectCache::download(RemoteFetch& fetch)
+{
+    auto url = remote();
+
+    // the compilation might have finished while the download was queued
+    if (!url || fetch.claimed) {
+        fetch.state = RemoteFetch::State::Missed;
+        return;
+    }
+
+    auto response = Http::Request(*url, "GET", "/" + Hash::ToHex(fetch.key), "", Config::the().int_flag("remote-timeout", 2000));
+    if (!response) {
+        remote_failed();
+    }
+
+    Entry entry {};
+    EntryHeader header {};
+    if (!response || response->status() != 200 || !DecodeEntry(response->body, fetch.temporary, entry, header)) {
+        fetch.state = RemoteFetch::State::Missed;
+        return;
+    }
+
+    // kept locally as well, for the next builds
+    bool stored = write_file(entry_path(fetch.key), response->body);
+    bool won = !fetch.claimed.exchange(true);
+    if (!won) {
+        unlink(fetch.temporary.c_str());
+        fetch.state = RemoteFetch::State::Missed;
+    }
+
+    {
+        auto _ = std::lock_guard(m_mutex);
+        if (stored) {
+            m_delta.entries++;
+            m_delta.object_bytes += header.object_size;
+            m_delta.stored_bytes += response->body.size();
+        }
+        if (won) {
+            m_delta.remote_hits++;
+            m_delta.cpu_time_saved += header.cpu_time;
+            m_delta.bytes_served += header.object_size;
+        }
+        m_delta_dirty = true;
+    }
+    wake_writer();
+
+    if (won) {
+        fetch.entry = std::move(entry);
+        fetch.state = RemoteFetch::State::Fetched;
+    }
+}
+
+void ObjectCache::upload(uint64_t key, const std::string& content)
+{
+    auto url = remote();
+    if (!url) {
+        return;
+    }
+
+    auto response = Http::Request(*url, "PUT", "/" + Hash::ToHex(key), content, Config::the().int_flag("remote-timeout", 2000));
+    if (!response) {
+        remote_failed();
+    }
+}
+
+bool ObjectCache::SettledRemotely(RemoteFetch& fetch)
+{
+    if (!fetch.claimed.exchange(true)) {
+        return false;
+    }
+
+    while (fetch.state == RemoteFetch::State::Pending) {
+        std::this_thread::yield();
+    }
+    return fetch.state == RemoteFetch::State::Fetched && rename(fetch.temporary.c_str(), fetch.object.c_str()) == 0;
+}
+
+void ObjectCache::DropRemote(RemoteFetch& fetch)
+{
+    if (!fetch.claimed.exchange(true)) {
+        return;
+    }
+
+    while (fetch.state == RemoteFetch::State::Pending) {
+        std::this_thread::yield();
+    }
+    if (fetch.state == RemoteFetch::State::Fetched) {
+        unlink(fetch.temporary.c_str());
+    }
+}
+
+ObjectCache::Stats ObjectCache::merge_stats(const Stats& delta)
+{
+    std::error_code error {};
+    std::filesystem::create_directories(directory(), error);
+
+    auto path = directory() / StatsFile;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return {};
+    }
+    flock(fd, LOCK_EX);
+
+    auto stats = ReadStats(fd);
+    stats.hits += delta.hits;
+    stats.remote_hits += delta.remote_hits;
+    stats.misses += delta.misses;
+    stats.cpu_time_saved += delta.cpu_time_saved;
+    stats.bytes_served += delta.bytes_served;
+    stats.entries += delta.entries;
+    stats.object_bytes += delta.object_bytes;
+    stats.stored_bytes += delta.stored_bytes;
+    WriteStats(fd, stats);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return stats;
+}
+
+// Removes the least recently used entries until the cache takes 90% of its limit.
+// The sizes in the stats file are recounted, as they drift with entries replaced by concurrent builds.
+void ObjectCache::evict()
+{
+    struct Candidate {
+        std::string path {};
+        timespec used {};
+        uint64_t object_size {};
+        uint64_t stored_size {};
+    };
+
+    auto stats_path = directory() / StatsFile;
+    int stats_fd = open(stats_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (stats_fd < 0) {
+        return;
+    }
+    flock(stats_fd, LOCK_EX);
+
+    std::vector<Candidate> candidates {};
+    uint64_t stored_bytes = 0;
+    uint64_t object_bytes = 0;
+
+    auto now = time(nullptr);
+    auto root = directory().string();
+    if (auto cache_directory = opendir(root.c_str())) {
+        while (auto shard = readdir(cache_directory)) {
+            if (strlen(shard->d_name) != 2) {
+                continue;
+            }
+
+            auto shard_path = root + "/" + shard->d_name;
+            auto shard_directory = opendir(shard_path.c_str());
+            if (!shard_directory) {
+                continue;
+            }
+
+            while (auto file = readdir(shard_directory)) {
+                std::string name = file->d_name;
+                auto file_path = shard_path + "/" + name;
+
+                struct stat file_stat {};
+                if (name.starts_with(".") || stat(file_path.c_str(), &file_stat) < 0) {
+                    continue;
+                }
+
+                // left by a build that was killed in the middle of writing
+                if (name.find(".tmp.") != std::string::npos) {
+                    if (now - file_stat.st_mtime > 3600) {
+                        unlink(file_path.c_str());
+                    }
+                    continue;
+                }
+                if (!name.ends_with(EntryExtension)) {
+                    continue;
+                }
+
+                EntryHeader header {};
+                int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    continue;
+                }
+                bool read = Utils::ReadAll(fd, &header, sizeof(header));
+                close(fd);
+                if (!read || !ValidHeader(header, file_stat.st_size)) {
+                    unlink(file_path.c_str());
+                    continue;
+                }
+
+                candidates.push_back(Candidate {
+                    .path = file_path,
+                    .used = file_stat.st_mtim,
+                    .object_size = header.object_size,
+                    .stored_size = static_cast<uint64_t>(file_stat.st_size),
+                });
+                stored_bytes += file_stat.st_size;
+                object_bytes += header.object_size;
+            }
+            closedir(shard_directory);
+        }
+        closedir(cache_directory);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+    });
+
+    auto target = size_limit() / 10 * 9;
+    size_t evicted = 0;
+    while (stored_bytes > target && evicted < candidates.size()) {
+        auto& candidate = candidates[evicted++];
+        if (unlink(candidate.path.c_str()) == 0) {
+            stored_bytes -= candidate.stored_size;
+            object_bytes -= candidate.object_size;
+        }
+    }
+
+    auto stats = ReadStats(stats_fd);
+    stats.entries = candidates.size() - evicted;
+    stats.stored_bytes = stored_bytes;
+    stats.object_bytes = object_bytes;
+    WriteStats(stats_fd, stats);
+
+    flock(stats_fd, LOCK_UN);
+    close(stats_fd);
+}
+
+ObjectCache::Stats ObjectCache::ReadStats(int fd)
+{
+    std::string content {};
+    struct stat stats_stat {};
+    if (fstat(fd, &stats_stat) == 0) {
+        content.resize(stats_stat.st_size);
+    }
+    if (pread(fd, content.data(), content.size(), 0) != static_cast<ssize_t>(content.size())) {
+        return {};
+    }
+
+    Stats stats {};
+    std::unordered_map<std::string, uint64_t*> fields {
+        { "hits", &stats.hits },
+        { "remote_hits", &stats.remote_hits },
+        { "misses", &stats.misses },
+        { "cpu_time_saved", &stats.cpu_time_saved },
+        { "bytes_served", &stats.bytes_served },
+        { "entries", &stats.entries },
+        { "object_bytes", &stats.object_bytes },
+        { "stored_bytes", &stats.stored_bytes },
+    };
+
+    std::stringstream lines(content);
+    std::string name;
+    uint64_t value;
+    while (lines >> name >> value) {
+        if (auto field = fields.find(name); field != fields.end()) {
+            *field->second = value;
+        }
+    }
+    return stats;
+}
+
+void ObjectCache::WriteStats(int fd, const Stats& stats)
+{
+    std::stringstream content;
+    content << "hits " << stats.hits << "\n"
+            << "remote_hits " << stats.remote_hits << "\n"
+            << "misses " << stats.misses << "\n"
+            << "cpu_time_saved " << stats.cpu_time_saved << "\n"
+            << "bytes_served " << stats.bytes_served << "\n"
+            << "entries " << stats.entries << "\n"
+            << "object_bytes " << stats.object_bytes << "\n"
+            << "stored_bytes " << stats.stored_bytes << "\n";
+
+    auto text = content.str();
+    if (ftruncate(fd, 0) == 0) {
+        pwrite(fd, text.data(), text.size(), 0);
+    }
+}
+
+void ObjectCache::print_stats()
+{
+    flush();
+
+    Stats stats {};
+    auto path = directory() / StatsFile;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        flock(fd, LOCK_SH);
+        stats = ReadStats(fd);
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+
+    auto lookups = stats.hits + stats.remote_hits + stats.misses;
+    auto hit_rate = lookups ? 100.0 * (stats.hits + stats.remote_hits) / lookups : 0.0;
+    auto compression_saved = stats.object_bytes > stats.stored_bytes ? stats.object_bytes - stats.stored_bytes : 0;
+
+    std::stringstream line;
+    line << std::fixed << std::setprecision(1);
+
+    Log(Color::Blue, "Cache directory:", directory().string());
+    line << hit_rate << "% (" << stats.hits << " local hits, " << stats.remote_hits << " remote hits, " << stats.misses << " misses)";
+    Log(Color::Green, "Hit rate:", line.str());
+    line.str("");
+    line << stats.cpu_time_saved / 1000.0 << " s";
+    Log(Color::Green, "CPU time saved:", line.str());
+    Log(Color::Green, "Bytes saved:", FormatBytes(stats.bytes_served), "of objects served from the cache,", FormatBytes(compression_saved), "by compression");
+    Log(Color::Green, "Size:", FormatBytes(stats.stored_bytes), "of", FormatBytes(size_limit()) + ",", stats.entries, "entries");
+}
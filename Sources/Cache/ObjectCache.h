@@ -0,0 +1,155 @@
+/*
+ * ObjectCache is a content-addressed store of compiled objects shared by all the projects of a user.
+ * An entry is keyed on everything the compilation depends on, so an object compiled once
+ * is materialized from the store instead of being compiled again.
+ *
+ * Entries are compressed and written by a background thread, which also evicts
+ * the least recently used ones once the cache grows over its size limit.
+ *
+ * With a remote cache, missing entries are downloaded while the object compiles
+ * and the compiled ones are uploaded by the background thread.
+ */
+
+#pragma once
+
+#include "../Utils/Http.h"
+#include "../Utils/Lock.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Output of the compiler, replayed on a hit
+struct CacheEntry {
+    std::string std_out {};
+    std::string std_err {};
+};
+
+// A download racing the compilation of an object, whichever finishes first provides the object
+struct RemoteFetch {
+    enum class State {
+        Pending,
+        Missed,
+        Fetched,
+    };
+
+    uint64_t key {};
+    std::filesystem::path object {};
+    std::filesystem::path temporary {};
+    std::atomic<State> state { State::Pending };
+    std::atomic<bool> claimed {};
+    CacheEntry entry {};
+};
+
+class ObjectCache {
+public:
+    static constexpr auto StatsFile = "stats";
+    static constexpr auto EntryExtension = ".entry";
+
+    using Entry = CacheEntry;
+
+    // Kept in the stats file of the cache, shared by all the builds using it
+    struct Stats {
+        uint64_t hits {};
+        uint64_t remote_hits {};
+        uint64_t misses {};
+        uint64_t cpu_time_saved {};
+        uint64_t bytes_served {};
+        uint64_t entries {};
+        uint64_t object_bytes {};
+        uint64_t stored_bytes {};
+    };
+
+public:
+    static ObjectCache& the()
+    {
+        static auto instance = ObjectCache();
+        return instance;
+    }
+
+    // Off unless asked for: "-cache" or "-cache~on" uses the default folder, "-cache~<path>" another one.
+    // A remote cache turns it on as well, "-cache~off" keeps it off.
+    bool enabled() const;
+    std::filesystem::path directory() const;
+    // "-cache-size~<MiB>", 5 GiB by default
+    uint64_t size_limit() const;
+    // "-remote-cache~http://host:port/path"
+    std::optional<Http::Url> remote() const;
+
+    // Identifies the compiler binary by its resolved path, size and modification time
+    uint64_t compiler_fingerprint(const std::string& compiler);
+
+    std::optional<Entry> fetch(uint64_t key, const std::filesystem::path& object);
+    // Only opens the object, it's compressed, written and uploaded by the background thread
+    void store(uint64_t key, const std::filesystem::path& object, const std::string& std_out, const std::string& std_err, uint64_t cpu_time);
+
+    // Starts downloading the entry from the remote cache, nothing if there's no remote cache.
+    // At most "-remote-downloads~<count>" (4 by default) downloads run at once.
+    std::shared_ptr<RemoteFetch> fetch_remote(uint64_t key, const std::filesystem::path& object);
+
+    // Settles the race once the compilation finished or was killed:
+    // true if the download came first and its object replaced the compiled one
+    static bool SettledRemotely(RemoteFetch& fetch);
+    // The object isn't needed anymore, a downloaded one is removed
+    static void DropRemote(RemoteFetch& fetch);
+
+    // Waits for the pending entries and records the statistics
+    void flush();
+    void print_stats();
+
+private:
+    struct PendingEntry {
+        uint64_t key {};
+        int object_fd { -1 };
+        std::string std_out {};
+        std::string std_err {};
+        uint64_t cpu_time {};
+    };
+
+private:
+    ObjectCache() = default;
+
+    std::filesystem::path entry_path(uint64_t key) const;
+
+    void wake_writer();
+    void run_writer();
+    bool write_entry(const PendingEntry& pending, Stats& delta, std::string& content);
+    bool write_file(const std::filesystem::path& path, const std::string& content);
+    void run_downloader();
+    void download(RemoteFetch& fetch);
+    void upload(uint64_t key, const std::string& content);
+    void remote_failed();
+    Stats merge_stats(const Stats& delta);
+    void evict();
+
+    static Stats ReadStats(int fd);
+    static void WriteStats(int fd, const Stats& stats);
+
+private:
+    SpinLock m_lock {};
+    std::unordered_map<std::string, uint64_t> m_fingerprints {};
+
+    // Background writer
+    std::mutex m_mutex {};
+    std::condition_variable m_wakeup {};
+    std::thread* m_writer {};
+    bool m_stopping {};
+    std::deque<PendingEntry> m_pending {};
+    Stats m_delta {};
+    bool m_delta_dirty {};
+
+    // Downloads from the remote cache
+    std::condition_variable m_download_wakeup {};
+    std::vector<std::thread*> m_downloaders {};
+    std::deque<std::shared_ptr<RemoteFetch>> m_downloads {};
+    std::atomic<bool> m_remote_unreachable {};
+};
@@ -0,0 +1,121 @@
+/*
+ * MacaCacheServer is a reference remote object cache: entries are stored as files
+ * named by their key and transferred with GET / PUT requests.
+ *
+ * Usage: MacaCacheServer [port] [directory] [address]
+ */
+
+#include "../Utils/Http.h"
+#include "../Utils/Logger.h"
+#include "../Utils/Socket.h"
+#include "../Utils/Utils.h"
+
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static std::filesystem::path s_directory = "macacache";
+
+static bool ValidKey(const std::string& key)
+{
+    return key.size() == 16 && key.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+static void Respond(int connection, int status, const std::string& reason, const std::string& body = {})
+{
+    Http::WriteMessage(connection, "HTTP/1.1 " + std::to_string(status) + " " + reason, body);
+}
+
+static void Handle(int connection)
+{
+    Socket::SetTimeout(connection, 30 * 1000);
+
+    Http::Message request {};
+    if (!Http::ReadMessage(connection, request)) {
+        close(connection);
+        return;
+    }
+
+    // only the last segment matters, clients may prefix keys with a path
+    auto target = request.target();
+    auto key = target.substr(target.rfind('/') + 1);
+    if (!ValidKey(key)) {
+        Respond(connection, 400, "Bad Request");
+        close(connection);
+        return;
+    }
+
+    auto path = s_directory / key.substr(0, 2) / key.substr(2);
+
+    if (request.method() == "GET") {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat entry_stat {};
+        if (fd < 0 || fstat(fd, &entry_stat) < 0) {
+            Respond(connection, 404, "Not Found");
+        } else {
+            std::string content(entry_stat.st_size, '\0');
+            if (Utils::ReadAll(fd, content.data(), content.size())) {
+                Respond(connection, 200, "OK", content);
+            } else {
+                Respond(connection, 500, "Internal Server Error");
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    } else if (request.method() == "PUT") {
+        std::error_code error {};
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        // renamed into place, concurrent readers never see a partial entry
+        auto temporary = std::filesystem::path(path).concat(".tmp." + std::to_string(gettid()));
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool written = fd >= 0 && Utils::WriteAll(fd, request.body.data(), request.body.size());
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (written && rename(temporary.c_str(), path.c_str()) == 0) {
+            Respond(connection, 201, "Created");
+        } else {
+            unlink(temporary.c_str());
+            Respond(connection, 500, "Internal Server Error");
+        }
+    } else {
+        Respond(connection, 405, "Method Not Allowed");
+    }
+
+    close(connection);
+}
+
+int main(int argc, char** argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : 8484;
+    if (argc > 2) {
+        s_directory = argv[2];
+    }
+    std::string address = argc > 3 ? argv[3] : "127.0.0.1";
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = Socket::Listen(address, port);
+    if (server < 0) {
+        Log(Color::Red, "can't listen on", address + ":" + std::to_string(port) + ":", strerror(errno));
+        return 1;
+    }
+
+    Log(Color::Magenta, "Serving the object cache in", s_directory.string(), "at", "http://" + address + ":" + std::to_string(port));
+    Logger::the().flush();
+
+    for (;;) {
+        int connection = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            continue;
+        }
+        std::thread(Handle, connection).detach();
+    }
+}
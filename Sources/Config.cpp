@@ -1,9 +1,18 @@
 #include "Config.h"
+#include "Profiler/Profiler.h"
+#include "Utils/Logger.h"
 
+#include <charconv>
+#include <chrono>
 #include <iostream>
 #include <string>
 
 Config::Config()
+{
+    update_timestamp();
+}
+
+void Config::update_timestamp()
 {
     const auto now = std::chrono::system_clock::now();
     m_timestamp = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
@@ -11,13 +20,19 @@ Config::Config()
 
 void Config::process_arguments(int argc, char** argv)
 {
+    m_argv = argv;
+    m_arguments.clear();
+    m_flags.clear();
+
     if (argc > 0) {
         m_filename = std::string(argv[0]);
         for (size_t at = 1; at < argc; at++) {
             std::string arg = argv[at];
             if (arg.starts_with('-')) {
+                // "--flag" is accepted as a spelling of "-flag"
+                size_t start = arg.starts_with("--") ? 2 : 1;
                 auto del = arg.find('~');
-                auto key = arg.substr(1, del - 1);
+                auto key = arg.substr(start, del == std::string::npos ? std::string::npos : del - start);
                 std::string val;
                 if (del != std::string::npos) {
                     val = arg.substr(del + 1, arg.size());
@@ -29,15 +44,58 @@ void Config::process_arguments(int argc, char** argv)
         }
     }
 
+    Logger::the().set_verbose(m_flags.contains("verbose"));
+    Profiler::the().set_enabled(m_flags.contains("profile"));
+
     if (m_arguments.empty()) {
         m_mode = Mode::Default;
         return;
     }
 
-    if (m_arguments.size() == 1 && m_arguments[0] == "generate") {
+    if (m_arguments.size() <= 2 && m_arguments[0] == "generate") {
         m_mode = Mode::Generate;
         return;
     }
 
+    if (m_arguments.size() == 1 && m_arguments[0] == "watch") {
+        m_mode = Mode::Watch;
+        return;
+    }
+
+    if (m_arguments.size() == 1 && m_arguments[0] == "server") {
+        m_mode = Mode::Server;
+        return;
+    }
+
+    if (m_arguments.size() == 2 && m_arguments[0] == "cache") {
+        m_mode = Mode::Cache;
+        return;
+    }
+
+    if (m_arguments.size() == 2 && m_arguments[0] == "analyze") {
+        m_mode = Mode::Analyze;
+        return;
+    }
+
     m_mode = Mode::CommandList;
-}
\ No newline at end of file
+}
+
+int Config::int_flag(const std::string& key, int fallback) const
+{
+    auto flag = m_flags.find(key);
+    if (flag == m_flags.end() || flag->second.empty()) {
+        return fallback;
+    }
+
+    int value = 0;
+    auto& text = flag->second;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        auto _ = ScopedLocker(m_warned_flags_lock);
+        if (m_warned_flags.insert(key + "~" + text).second) {
+            Log(Color::Yellow, "ignoring -" + key + "~" + text + ", not a number, using", fallback);
+        }
+        return fallback;
+    }
+    return value;
+}
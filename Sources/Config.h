@@ -1,7 +1,10 @@
 #pragma once
 
+#include "Utils/Lock.h"
+
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 class Config {
@@ -10,6 +13,10 @@ public:
         Generate,
         Default,
         CommandList,
+        Watch,
+        Server,
+        Cache,
+        Analyze,
     };
 
 public:
@@ -21,21 +28,34 @@ public:
 
 public:
     void process_arguments(int argc, char** argv);
+    void update_timestamp();
 
 public:
     const auto& filename() const { return m_filename; }
+    char** argv() const { return m_argv; }
     const auto& arguments() const { return m_arguments; }
     auto& flags()  { return m_flags; }
     Mode mode() const { return m_mode; }
+
+    // Whether the process outlives a single build, so build errors mustn't terminate it
+    bool persistent() const { return m_persistent || m_mode == Mode::Watch; }
+    void set_persistent(bool persistent) { m_persistent = persistent; }
     int timestamp() const { return m_timestamp; }
 
+    // A value that isn't a number is reported once and replaced by the fallback
+    int int_flag(const std::string& key, int fallback) const;
+
 private:
     Config();
 
 private:
     int m_timestamp;
     std::string m_filename {};
+    char** m_argv {};
     std::vector<std::string> m_arguments {};
     std::unordered_map<std::string, std::string> m_flags {};
     Mode m_mode {};
+    bool m_persistent {};
+    mutable SpinLock m_warned_flags_lock {};
+    mutable std::unordered_set<std::string> m_warned_flags {};
 };
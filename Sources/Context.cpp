@@ -1,24 +1,58 @@
 #include "Context.h"
 
+#include "Analyzer/HeaderAnalyzer.h"
+#include "Cache/ObjectCache.h"
 #include "Config.h"
+#include "Executor/Dispatcher.h"
 #include "Executor/ExecutableUnit.h"
 #include "Executor/Executor.h"
+#include "Executor/JobOutput.h"
 #include "Finder/Finder.h"
+#include "Finder/GlobCache.h"
+#include "Finder/StatCache.h"
+#include "HashDumper.h"
+#include "HashParser.h"
+#include "Parser/ParseCache.h"
 #include "Parser/Parser.h"
+#include "Profiler/Profiler.h"
 #include "TimeStampDumper.h"
 #include "TimeStampParser.h"
+#include "Translator/NinjaTranslator.h"
 #include "Translator/Translator.h"
+#include "Utils/Interner.h"
 
+#include <cstring>
+#include <iostream>
 #include <numeric>
 #include <thread>
+#include <unistd.h>
 #include <utility>
 
-std::unordered_map<std::string, Context*> Context::s_processing_contexts = {};
+PathArray<Context*> Context::s_processing_contexts = {};
 SpinLock Context::m_lock = {};
 
+// Without empty, "." or ".." parts a relative path is already lexically normal
+static bool IsPlain(std::string_view path)
+{
+    if (path.empty() || path.front() == '/') {
+        return false;
+    }
+    for (size_t start = 0; start <= path.size();) {
+        auto end = std::min(path.find('/', start), path.size());
+        auto part = path.substr(start, end - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
 static int last_modification_time(const std::filesystem::path& file)
 {
-    return static_cast<int>(std::filesystem::last_write_time(file).time_since_epoch() / std::chrono::seconds(1));
+    // std::filesystem::file_time_type isn't guaranteed to share the epoch of the
+    // system clock, while the timestamps file stores Config::timestamp() values.
+    return StatCache::the().mtime(file);
 }
 
 Context::Context(std::filesystem::path path, Context::Operation operation, const DefinesField& defines, bool root_ctx)
@@ -27,24 +61,85 @@ Context::Context(std::filesystem::path path, Context::Operation operation, const
     , m_defines(defines)
     , m_root_ctx(root_ctx)
 {
-    parser = Parser(m_path, this);
 }
 
 void Context::run()
 {
     m_thread = new std::thread([this]() {
-        parser.run();
-        validate_fields();
-        merge_children();
-        process_by_mode();
+        {
+            auto _ = ProfileScope(Profiler::Phase::Parse);
+            ParseCache cache(this);
+            if (!cache.load()) {
+                parser = Parser(m_path, this);
+                parser.run();
+                if (m_state != State::ParseError) {
+                    cache.store();
+                }
+            }
+        }
+        if (m_state != State::ParseError && validate_fields() && merge_children()) {
+            process_by_mode();
+        }
 
+        // the root finishes last, every phase of the run is recorded by now
+        if (m_root_ctx) {
+            Profiler::the().report();
+        }
         m_done = true;
     });
 }
 
-bool Context::run_as_childs(const std::string& pattern, Operation operation)
+Context::~Context()
+{
+    if (m_thread && m_thread->joinable()) {
+        m_thread->join();
+    }
+    delete m_thread;
+}
+
+void Context::rerun()
+{
+    if (m_thread && m_thread->joinable()) {
+        m_thread->join();
+    }
+    delete m_thread;
+    m_thread = nullptr;
+
+    m_done = false;
+    // nothing can be built until the .maca files are fixed, which reparses them
+    if (m_state == State::ParseError) {
+        Log(Color::Red, m_error);
+        m_done = true;
+        return;
+    }
+    m_thread = new std::thread([this]() {
+        process_by_mode();
+        if (m_root_ctx) {
+            Profiler::the().report();
+        }
+        m_done = true;
+    });
+}
+
+void Context::invalidate(const std::filesystem::path& file)
+{
+    m_include_graph.erase(file.lexically_normal().string());
+}
+
+void Context::invalidate_sources()
+{
+    m_found_sources.clear();
+    m_include_graph.clear();
+    m_header_index.clear();
+}
+
+bool Context::run_as_childs(const std::string& pattern, Operation operation, const std::vector<std::string>& exclusions)
 {
-    auto maca_files = Finder::FindMacaFiles(directory(), pattern);
+    std::vector<std::filesystem::path> maca_files {};
+    {
+        auto _ = ProfileScope(Profiler::Phase::Glob);
+        maca_files = Finder::FindMacaFiles(directory(), pattern, exclusions);
+    }
     if (maca_files.empty()) {
         return false;
     }
@@ -63,25 +158,51 @@ bool Context::run_as_childs(const std::string& pattern, Operation operation)
     return true;
 }
 
-void Context::validate_fields()
+bool Context::spawn_children(const std::vector<std::shared_ptr<std::string>>& patterns, Operation operation, size_t line)
+{
+    m_spawns.push_back({ .operation = operation, .line = line, .patterns = patterns, .defines = m_defines });
+
+    auto exclusions = Finder::GetExclusions(directory(), patterns);
+    for (auto& pattern : patterns) {
+        if (Finder::IsExclusion(*pattern)) {
+            continue;
+        }
+        if (!run_as_childs(*pattern, operation, exclusions)) {
+            auto error = operation == Operation::Parse ? "Included path \"" + *pattern + "\" does not exist" : "referenced dependency \"" + *pattern + "\" does not exist";
+            return trigger_error("line " + std::to_string(line) + ": " + error);
+        }
+    }
+    return true;
+}
+
+bool Context::validate_fields()
 {
     if (m_build.type() == BuildField::Type::Executable) {
         if (m_build.archiver()) {
-            trigger_error("can\'t use Archiver subfield for Executable type");
+            return trigger_error("can\'t use Archiver subfield for Executable type");
         }
     } else if (m_build.type() == BuildField::Type::StaticLib) {
         if (m_build.linker() || !m_build.linker_flags().empty()) {
-            trigger_error("can\'t use Link subfield for StaticLib type");
+            return trigger_error("can\'t use Link subfield for StaticLib type");
         }
     }
+    return true;
 }
 
 bool Context::merge_children()
 {
-    for (auto child : m_children) {
-        if (child->operation() == Context::Operation::Parse) {
-            while (child->m_state != Context::State::Parsed) {
-                std::this_thread::yield();
+    {
+        auto _ = ProfileScope(Profiler::Phase::WaitChildren);
+        for (auto child : m_children) {
+            if (child->operation() == Context::Operation::Parse) {
+                while (child->m_state != Context::State::Parsed && child->m_state != Context::State::ParseError) {
+                    std::this_thread::yield();
+                }
+                // only the server and watch modes get here, the child has logged its error already
+                if (child->m_state == Context::State::ParseError) {
+                    m_error = child->m_error;
+                    return fail_build();
+                }
             }
         }
     }
@@ -116,6 +237,10 @@ void Context::process_by_mode()
         // Build is a special command word that's reserved for unit building
         if (cmd == "Build") {
             build();
+            // the root is built last, so every rebuilt node is recorded by now
+            if (m_root_ctx) {
+                Explainer::the().report();
+            }
         } else {
             for (auto& command : m_commands.command_list(cmd)) {
                 Executor::blocking_cmd(*command);
@@ -141,64 +266,318 @@ void Context::process_by_mode()
     }
 
     if (mode == Config::Mode::Generate) {
-        Translator::generate_cmake(this);
+        if (arguments.size() == 1 || arguments[1] == "cmake") {
+            Translator::generate_cmake(this);
+            return;
+        }
+        // the edges of a context need the outputs of its children
+        for (auto child : m_children) {
+            while (!child->done()) {
+                std::this_thread::yield();
+            }
+        }
+        NinjaTranslator::the().collect(this);
+        if (m_root_ctx) {
+            NinjaTranslator::the().generate(this);
+        }
+        return;
+    }
+
+    if (mode == Config::Mode::Analyze) {
+        HeaderAnalyzer::the().collect(this);
+        // children wait for their own children, so the whole graph is collected once the root's are done
+        for (auto child : m_children) {
+            while (!child->done()) {
+                std::this_thread::yield();
+            }
+        }
+        if (m_root_ctx) {
+            HeaderAnalyzer::the().report(this);
+        }
+        return;
+    }
+
+    if (mode == Config::Mode::Watch) {
+        build();
+    }
+}
+
+// A file matched by several Src patterns is only taken the first time
+std::vector<std::filesystem::path> Context::collect_sources()
+{
+    std::vector<std::filesystem::path> files {};
+    std::unordered_set<std::string> taken {};
+    auto exclusions = Finder::GetExclusions(directory(), m_build.sources());
+    for (auto& source : m_build.sources()) {
+        if (Finder::IsExclusion(*source)) {
+            continue;
+        }
+        for (auto& file : find_sources(*source, exclusions)) {
+            if (taken.insert(file.lexically_normal().string()).second) {
+                files.push_back(file);
+            }
+        }
+    }
+    return files;
+}
+
+const std::vector<std::filesystem::path>& Context::find_sources(const std::string& pattern, const std::vector<std::string>& exclusions)
+{
+    auto found = m_found_sources.find(pattern);
+    if (found == m_found_sources.end()) {
+        auto _ = ProfileScope(Profiler::Phase::Glob);
+        found = m_found_sources.emplace(pattern, Finder::FindFiles(directory(), pattern, exclusions)).first;
+    }
+    return found->second;
+}
+
+bool Context::fail_build()
+{
+    if (!Config::the().persistent()) {
+        Explainer::the().report();
+        Profiler::the().report();
+        ObjectCache::the().flush();
+        GlobCache::the().save();
+        exit(1);
+    }
+
+    m_state = m_state == State::NotStarted ? State::ParseError : State::BuildError;
+    return false;
+}
+
+void Context::run_finalizer(const std::shared_ptr<ExecutableUnit>& finalizer)
+{
+    done_finalizer = false;
+    Executor::the().enqueue(finalizer);
+
+    while (!done_finalizer) {
+        std::this_thread::yield();
+    }
+}
+
+// Members of an archive are recorded as "lib(member)" with the hash they were archived with,
+// so only the changed ones are replaced and the ones of removed sources are deleted.
+void Context::update_archive(const std::shared_ptr<ExecutableUnit>& full_archive, const std::vector<std::pair<std::string, uint64_t>>& members)
+{
+    auto& lib = *full_archive->binary;
+    auto member_prefix = lib + "(";
+
+    std::unordered_map<std::string, uint64_t> archived {};
+    for (auto& [key, hash] : m_hashes) {
+        if (key.starts_with(member_prefix) && key.ends_with(")")) {
+            archived[key.substr(member_prefix.size(), key.size() - member_prefix.size() - 1)] = hash;
+        }
+    }
+
+    // ar addresses members by their file names only
+    bool names_unique = true;
+    std::unordered_map<std::string, std::string> names {};
+    auto check_name = [&](const std::string& member) {
+        auto [name, inserted] = names.emplace(std::filesystem::path(member).filename(), member);
+        if (!inserted && name->second != member) {
+            names_unique = false;
+        }
+    };
+    for (auto& [member, _] : archived) {
+        check_name(member);
+    }
+    for (auto& [member, _] : members) {
+        check_name(member);
+    }
+
+    if (archived.empty() || !names_unique || !StatCache::the().exists(cwd() / lib)) {
+        // rcs on an existing archive would keep the members of removed sources
+        std::error_code error {};
+        std::filesystem::remove(cwd() / lib, error);
+        run_finalizer(full_archive);
+    } else {
+        auto make_unit = [&](const char* operation, std::vector<std::shared_ptr<std::string>>&& files) {
+            std::vector<std::shared_ptr<std::string>> args {};
+            args.push_back(std::make_shared<std::string>(operation));
+            args.push_back(full_archive->binary);
+            std::move(files.begin(), files.end(), std::back_inserter(args));
+
+            return std::make_shared<ExecutableUnit>(ExecutableUnit {
+                .op = ::Operation::Archive,
+                .ctx = this,
+                .callee = full_archive->callee,
+                .src = {},
+                .binary = full_archive->binary,
+                .args = std::move(args),
+                .cwd = cwd() });
+        };
+
+        std::unordered_set<std::string> current {};
+        std::vector<std::shared_ptr<std::string>> changed {};
+        for (auto& [member, hash] : members) {
+            current.insert(member);
+            auto recorded = archived.find(member);
+            if (recorded == archived.end() || recorded->second != hash) {
+                changed.push_back(std::make_shared<std::string>(member));
+            }
+        }
+
+        std::vector<std::shared_ptr<std::string>> removed {};
+        for (auto& [member, _] : archived) {
+            if (!current.contains(member)) {
+                removed.push_back(std::make_shared<std::string>(std::filesystem::path(member).filename()));
+            }
+        }
+
+        if (!removed.empty()) {
+            run_finalizer(make_unit("ds", std::move(removed)));
+        }
+        if (!changed.empty() && m_state != State::BuildError) {
+            run_finalizer(make_unit("rcs", std::move(changed)));
+        }
+    }
+
+    // an interrupted update leaves the membership unknown, the next build rewrites the archive
+    for (auto& [member, _] : archived) {
+        m_hashes.erase(member_prefix + member + ")");
+    }
+    if (m_state != State::BuildError) {
+        for (auto& [member, hash] : members) {
+            m_hashes[member_prefix + member + ")"] = hash;
+        }
     }
 }
 
 bool Context::build()
 {
-    fill_timestamps();
+    if (!m_timestamps_loaded) {
+        auto _ = ProfileScope(Profiler::Phase::TimestampLoad);
+        fill_timestamps();
+        fill_hashes();
+        fill_compile_times();
+        m_timestamps_loaded = true;
+    }
 
+    done_finalizer = false;
+    m_content_hashes.clear();
+    m_include_status.clear();
+    m_failed_sources.clear();
+    m_dirty_includes.clear();
+    m_dirty_reasons.clear();
+    m_object_reasons.clear();
+    m_output_reason.reset();
+
+    bool explain = Explainer::the().enabled();
     std::vector<std::shared_ptr<std::string>> objects {};
+    std::unordered_set<std::string> recompiled_objects {};
 
-    for (auto& source : m_build.sources()) {
-        auto files = Finder::FindFiles(directory(), *source);
+    // sources are found under the context's folder and spelled with it in front, it's cut off to get
+    // the path relative to the context; paths that aren't plain go through std::filesystem::proximate
+    auto folder = directory().native();
+    if (!folder.empty()) {
+        folder += '/';
+    }
+    auto objects_folder = maca_path() + "/";
+    std::string object {};
+    std::string object_folder {};
+    std::string proximate_source {};
 
-        for (auto& file : files) {
-            bool recompile_file = false;
-            if (scan_include(file) == IncludeStatus::NeedsRecompilation) {
-                recompile_file = true;
-            }
+    for (auto& file : collect_sources()) {
+        bool recompile_file = false;
+        if (scan_include(file) == IncludeStatus::NeedsRecompilation) {
+            recompile_file = true;
+        }
 
-            m_was_any_recompilation |= recompile_file;
+        auto option = m_build.get_option_for_file(file);
+        if (!option) {
+            return trigger_error("no option for file \"" + file.string() + "\"");
+        }
 
-            auto option = m_build.get_option_for_file(file);
-            if (!option) {
-                trigger_error("no option for file \"" + file.string() + "\"");
-            }
+        std::string_view relative_source = file.native();
+        if (relative_source.starts_with(folder) && IsPlain(relative_source.substr(folder.size()))) {
+            relative_source.remove_prefix(folder.size());
+        } else {
+            proximate_source = std::filesystem::proximate(file, cwd()).native();
+            relative_source = proximate_source;
+        }
+        auto source_arg = Interner::the().c_str(relative_source);
 
-            auto object = (maca_path() / std::filesystem::proximate(file, directory())).string() + ".o";
-            Finder::CreateDirectory(std::filesystem::path(object).parent_path());
+        object.assign(objects_folder).append(relative_source).append(".o");
+        // sources come sorted, the ones of a folder one after another
+        if (std::string_view(object).substr(0, object.rfind('/')) != object_folder) {
+            object_folder.assign(object, 0, object.rfind('/'));
+            Finder::CreateDirectory(object_folder);
+        }
 
-            auto relative_source = std::filesystem::proximate(file, directory());
-            auto relative_object = std::filesystem::proximate(object, directory());
+        // kept between builds, the link and archive commands share them
+        auto& relative_object = m_object_paths[source_arg];
+        if (!relative_object) {
+            relative_object = std::make_shared<std::string>(object, folder.size());
+        }
 
-            objects.push_back(std::make_shared<std::string>(relative_object));
+        objects.push_back(relative_object);
 
-            if (!recompile_file && std::filesystem::exists(object)) {
+        if (!recompile_file && StatCache::the().exists(object)) {
+            continue;
+        }
+
+        if (explain) {
+            auto reason = recompile_file ? explain_file(file) : Explainer::Reason { .cause = object + " missing", .chain = { file.lexically_normal().string() } };
+            m_object_reasons[*relative_object] = reason;
+            Explainer::the().record(std::move(reason));
+        }
+
+        recompiled_objects.insert(*relative_object);
+
+        auto& argv = argv_template(*option);
+
+        std::optional<uint64_t> key {};
+        if (ObjectCache::the().enabled()) {
+            key = cache_key(file, *argv, source_arg, relative_object->c_str());
+        }
+        if (key) {
+            if (auto entry = ObjectCache::the().fetch(*key, object)) {
+                if (!entry->std_out.empty() || !entry->std_err.empty()) {
+                    Log(Color::Yellow, "Cached with warnings:", file.string());
+                } else {
+                    LogProgress(Color::Green, "Cached:", file.string());
+                }
+                // the unit isn't made on a hit, the logs are named the way it would be
+                auto unit = ExecutableUnit { .binary = relative_object, .cwd = cwd() };
+                auto std_out = JobOutput::Console(entry->std_out, JobOutput::LogPath(unit, "stdout"));
+                auto std_err = JobOutput::Console(entry->std_err, JobOutput::LogPath(unit, "stderr"));
+                if (!std_out.empty()) {
+                    LogOutput(std_out);
+                }
+                if (!std_err.empty()) {
+                    LogOutput(std_err);
+                }
                 continue;
             }
+        }
 
-            auto flags = option->flags;
+        // the compiler has to create a new file, the old one might still be read by the cache
+        unlink(object.c_str());
 
-            // TODO: fix this!
-            if (*option->compiler != "nasm") {
-                flags.push_back(std::make_shared<std::string>("-c"));
-            }
-            flags.push_back(std::make_shared<std::string>(relative_source));
-            flags.push_back(std::make_shared<std::string>("-o"));
-            flags.push_back(std::make_shared<std::string>(relative_object));
+        std::shared_ptr<RemoteFetch> remote {};
+        if (key) {
+            remote = ObjectCache::the().fetch_remote(*key, object);
+        }
 
-            Executor::the().enqueue(std::make_shared<ExecutableUnit>(ExecutableUnit {
-                .op = ::Operation::Compile,
-                .ctx = this,
-                .callee = option->compiler,
-                .src = std::move(file),
-                .binary = nullptr,
-                .args = std::move(flags),
-                .cwd = cwd(),
-            }));
+        std::vector<std::string> inputs {};
+        if (Dispatcher::the().enabled()) {
+            auto files = dependencies(file);
+            inputs.assign(files.begin(), files.end());
         }
+
+        Executor::the().enqueue(std::make_shared<ExecutableUnit>(ExecutableUnit {
+            .op = ::Operation::Compile,
+            .ctx = this,
+            .callee = option->compiler,
+            .src = file,
+            .binary = relative_object,
+            .argv = argv,
+            .source_arg = source_arg,
+            .cwd = cwd(),
+            .cache_key = key,
+            .remote = std::move(remote),
+            .inputs = std::move(inputs),
+        }));
     }
 
     // wait for the compilation of all objects
@@ -206,38 +585,69 @@ bool Context::build()
         std::this_thread::yield();
     }
 
-    dump_timestamps();
+    // objects are hashed once produced, so the finalizer can tell whether they actually changed
+    std::vector<std::string> changed_objects {};
+    for (auto& object : objects) {
+        if (recompiled_objects.contains(*object) || !m_hashes.contains(*object)) {
+            if (auto hash = Hash::File(cwd() / *object)) {
+                if (recorded_hash(*object) != *hash) {
+                    changed_objects.push_back(*object);
+                }
+                m_hashes[*object] = *hash;
+            }
+        }
+    }
+
+    // The hashes go along with the timestamps, before a failing dependency can end the build:
+    // a recompiled object isn't hashed again, its old hash would make the next build skip the link.
+    {
+        auto _ = ProfileScope(Profiler::Phase::TimestampSave);
+        dump_timestamps();
+        dump_compile_times();
+        dump_hashes();
+    }
 
     // wait for the finalization of the dependent static libs
     auto dependency_libs = std::vector<std::shared_ptr<std::string>>();
+    auto dependency_hashes = std::vector<uint64_t>();
+    auto relinked_dependencies = std::vector<Explainer::Reason>();
     for (auto child : m_children) {
         if (child->operation() == Context::Operation::Build) {
+            auto _ = ProfileScope(Profiler::Phase::WaitChildren);
             while (child->m_build.type() == BuildField::Type::Unknown) {
                 std::this_thread::yield();
             }
             if (child->m_build.type() == BuildField::Type::StaticLib) {
-                auto dependency_lib_relative = std::filesystem::proximate(child->static_library_path(), directory());
+                auto dependency_lib_relative = std::filesystem::proximate(child->static_library_path(), cwd());
                 dependency_libs.push_back(std::make_shared<std::string>(dependency_lib_relative));
-                while (child->m_state != Context::State::Built) {
+                while (!child->build_finished()) {
                     std::this_thread::yield();
                 }
-                m_was_any_recompilation |= child->m_was_any_recompilation;
+                if (child->failed()) {
+                    m_state = State::BuildError;
+                }
+                dependency_hashes.push_back(child->m_output_hash);
+                if (child->m_output_reason) {
+                    relinked_dependencies.push_back(*child->m_output_reason);
+                }
             }
         }
     }
 
     // finalize objects
     if (m_state == State::BuildError) {
-        exit(1);
+        return fail_build();
     }
 
-    if (m_was_any_recompilation && !objects.empty()) {
+    if (!objects.empty()) {
+        std::shared_ptr<ExecutableUnit> finalizer {};
+
         if (m_build.type() == BuildField::Type::StaticLib) {
             size_t lastindex = m_path.string().find_last_of('.');
             std::string libname = m_path.string().substr(0, lastindex);
 
-            auto lib = (maca_path() / std::filesystem::proximate(libname, directory())).string() + ".a";
-            auto lib_relative = std::filesystem::proximate(lib, directory());
+            auto lib = (maca_path() / std::filesystem::proximate(libname, cwd())).string() + ".a";
+            auto lib_relative = std::filesystem::proximate(lib, cwd());
             auto lib_name = std::make_shared<std::string>(lib_relative);
 
             auto archiver_flags = std::vector<std::shared_ptr<std::string>>();
@@ -246,99 +656,349 @@ bool Context::build()
             std::copy(objects.begin(), objects.end(), std::back_inserter(archiver_flags));
             std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(archiver_flags));
 
-            Executor::the().enqueue(std::make_shared<ExecutableUnit>(ExecutableUnit {
+            finalizer = std::make_shared<ExecutableUnit>(ExecutableUnit {
                 .op = ::Operation::Archive,
                 .ctx = this,
                 .callee = m_build.archiver(),
                 .src = {},
                 .binary = lib_name,
                 .args = std::move(archiver_flags),
-                .cwd = cwd() }));
+                .cwd = cwd() });
         } else {
-            //            m_build.linker_flags().push_back(std::make_shared<std::string>("-Wl,--start-group"));
-            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(m_build.linker_flags()));
-            std::copy(objects.begin(), objects.end(), std::back_inserter(m_build.linker_flags()));
-            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(m_build.linker_flags()));
-            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(m_build.linker_flags()));
-            //            m_build.linker_flags().push_back(std::make_shared<std::string>("-Wl,--end-group"));
-
-            m_build.linker_flags().push_back(std::make_shared<std::string>("-o"));
-            auto link_exec = std::make_shared<std::string>(std::filesystem::proximate(executable_path(), directory()));
-            m_build.linker_flags().push_back(link_exec);
-
-            Executor::the().enqueue(std::make_shared<ExecutableUnit>(ExecutableUnit {
+            // the parsed flags are kept intact, so the context can be linked again
+            auto linker_flags = m_build.linker_flags();
+
+            //            linker_flags.push_back(std::make_shared<std::string>("-Wl,--start-group"));
+            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(linker_flags));
+            std::copy(objects.begin(), objects.end(), std::back_inserter(linker_flags));
+            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(linker_flags));
+            std::copy(dependency_libs.begin(), dependency_libs.end(), std::back_inserter(linker_flags));
+            //            linker_flags.push_back(std::make_shared<std::string>("-Wl,--end-group"));
+
+            linker_flags.push_back(std::make_shared<std::string>("-o"));
+            auto link_exec = std::make_shared<std::string>(std::filesystem::proximate(executable_path(), cwd()));
+            linker_flags.push_back(link_exec);
+
+            finalizer = std::make_shared<ExecutableUnit>(ExecutableUnit {
                 .op = ::Operation::Link,
                 .ctx = this,
                 .callee = m_build.linker(),
                 .src = {},
                 .binary = link_exec,
-                .args = std::move(m_build.linker_flags()),
-                .cwd = cwd() }));
+                .args = std::move(linker_flags),
+                .cwd = cwd() });
         }
 
-        while (!done_finalizer) {
-            std::this_thread::yield();
+        // Restat: the finalizer is skipped unless its command or the content of any of its inputs changed.
+        // The signature is recorded under the output path prefixed with '@', the output's own hash under its path
+        // and the hash of the command alone under the output path prefixed with '#'.
+        auto output = *finalizer->binary;
+        auto signature_key = "@" + output;
+        auto command_key = "#" + output;
+
+        uint64_t signature = Hash::String(*finalizer->callee);
+        uint64_t command = signature;
+        for (auto& arg : finalizer->args) {
+            signature = Hash::String(*arg, signature);
+            command = Hash::String(*arg, command);
+            if (*arg != output) {
+                signature = Hash::Combine(signature, recorded_hash(*arg));
+            }
+        }
+        for (auto dependency_hash : dependency_hashes) {
+            signature = Hash::Combine(signature, dependency_hash);
+        }
+
+        if (recorded_hash(signature_key) != signature || !StatCache::the().exists(cwd() / output)) {
+            if (explain) {
+                bool command_changed = recorded_hash(command_key) != 0 && recorded_hash(command_key) != command;
+                m_output_reason = explain_finalizer(output, command_changed, changed_objects, relinked_dependencies);
+                Explainer::the().record(*m_output_reason);
+            }
+
+            if (finalizer->op == ::Operation::Archive) {
+                std::vector<std::pair<std::string, uint64_t>> members {};
+                for (auto& object : objects) {
+                    members.emplace_back(*object, recorded_hash(*object));
+                }
+                for (size_t at = 0; at < dependency_libs.size(); at++) {
+                    members.emplace_back(*dependency_libs[at], dependency_hashes[at]);
+                }
+                update_archive(finalizer, members);
+            } else {
+                run_finalizer(finalizer);
+            }
+
+            m_hashes.erase(signature_key);
+            if (m_state != State::BuildError) {
+                if (auto hash = Hash::File(cwd() / output)) {
+                    m_hashes[output] = *hash;
+                    m_hashes[signature_key] = signature;
+                    m_hashes[command_key] = command;
+                }
+            }
         }
+
+        m_output_hash = recorded_hash(output);
+    }
+
+    {
+        auto _ = ProfileScope(Profiler::Phase::TimestampSave);
+        dump_hashes();
     }
 
     if (m_state == State::BuildError) {
-        exit(1);
+        return fail_build();
     }
 
     // make sure, that all the children are built
     for (auto child : m_children) {
         if (child->operation() == Context::Operation::Build) {
             if (child->m_build.type() == BuildField::Type::Executable) {
-                while (child->m_state != Context::State::Built) {
+                while (!child->build_finished()) {
                     std::this_thread::yield();
                 }
+                if (child->failed()) {
+                    return fail_build();
+                }
             }
         }
     }
 
     m_state = State::Built;
+    return true;
+}
+
+IncludeStatus Context::scan_include(const std::filesystem::path& file)
+{
+    size_t lowest_index = m_visited_stack.size();
+    return scan_include(file, lowest_index);
+}
+
+// Headers can include each other in a cycle behind #pragma once or include guards. All the files of
+// a cycle see the same headers, so they're settled together once its first file is done; until then
+// the others stay on the stack with a provisional status (Tarjan's strongly connected components).
+IncludeStatus Context::scan_include(const std::filesystem::path& file, size_t& lowest_index)
+{
+    auto id = PathTable::the().id(file);
 
-    if (root()) {
-        Executor::the().stop();
-        Executor::the().await();
+    auto visited = m_path_to_visited_stack_index.find(id);
+    if (visited != m_path_to_visited_stack_index.end()) {
+        lowest_index = std::min(lowest_index, visited->second);
+        return m_include_status[id];
     }
 
-    return false;
+    // pages never move, the status can be held on to while the includes are scanned
+    auto& status = m_include_status[id];
+    if (status != IncludeStatus::NotVisited) {
+        return status;
+    }
+
+    const auto& includes = resolve_includes(file);
+
+    auto index = m_visited_stack.size();
+    auto lowest = index;
+    m_visited_stack.push_back(file);
+    m_path_to_visited_stack_index[id] = index;
+    for (auto& include_path : includes) {
+        auto include_status = scan_include(include_path, lowest);
+        if (include_status == IncludeStatus::NeedsRecompilation) {
+            status = IncludeStatus::NeedsRecompilation;
+            if (Explainer::the().enabled()) {
+                m_dirty_includes.emplace(file.lexically_normal().string(), include_path.lexically_normal().string());
+            }
+        }
+    }
+
+    if (status != IncludeStatus::NeedsRecompilation) {
+        auto timestamp = m_timestamps.get(id);
+        if (last_modification_time(file) >= timestamp) {
+            status = IncludeStatus::NeedsRecompilation;
+            if (Explainer::the().enabled()) {
+                auto reason = timestamp == 0 ? "not built before" : "modified since the last build";
+                m_dirty_reasons.emplace(file.lexically_normal().string(), reason);
+            }
+        } else {
+            status = IncludeStatus::UpToDate;
+        }
+    }
+
+    if (lowest < index) {
+        lowest_index = std::min(lowest_index, lowest);
+        return status;
+    }
+
+    // the file is the first of its cycle, a dirty file anywhere in it makes the whole cycle dirty
+    const std::filesystem::path* dirty {};
+    for (size_t i = index; i < m_visited_stack.size() && !dirty; i++) {
+        if (m_include_status[PathTable::the().id(m_visited_stack[i])] == IncludeStatus::NeedsRecompilation) {
+            dirty = &m_visited_stack[i];
+        }
+    }
+    for (size_t i = index; i < m_visited_stack.size(); i++) {
+        auto& member = m_visited_stack[i];
+        auto member_id = PathTable::the().id(member);
+        if (dirty && m_include_status[member_id] != IncludeStatus::NeedsRecompilation) {
+            m_include_status[member_id] = IncludeStatus::NeedsRecompilation;
+            if (Explainer::the().enabled()) {
+                m_dirty_includes.emplace(member.lexically_normal().string(), dirty->lexically_normal().string());
+            }
+        }
+        m_path_to_visited_stack_index.erase(member_id);
+    }
+    m_visited_stack.erase(m_visited_stack.begin() + index, m_visited_stack.end());
+
+    return status;
 }
 
-IncludeStatus Context::scan_include(const std::filesystem::path& file)
+Explainer::Reason Context::explain_file(const std::filesystem::path& file) const
 {
-    auto path_in_timestamps_file = std::filesystem::proximate(file, directory());
+    // follows the first dirty include of every file down to the one that changed itself
+    Explainer::Reason reason {};
+    auto path = file.lexically_normal().string();
+    while (true) {
+        reason.chain.push_back(path);
+        auto include = m_dirty_includes.find(path);
+        if (include == m_dirty_includes.end()) {
+            break;
+        }
+        path = include->second;
+    }
 
-    if (m_path_to_visited_stack_index.contains(path_in_timestamps_file)) {
-        std::stringstream error_builder;
-        error_builder << "detected a circular dependency starting from \"" + file.string() + "\".\n\nInclude stack:\n\n";
-        for (size_t i = m_path_to_visited_stack_index[path_in_timestamps_file] ; i < m_visited_stack.size(); i++) {
-            error_builder << m_visited_stack[i] << "\n";
+    auto own_reason = m_dirty_reasons.find(path);
+    reason.cause = path + " " + (own_reason == m_dirty_reasons.end() ? "changed" : own_reason->second);
+    return reason;
+}
+
+Explainer::Reason Context::explain_finalizer(const std::string& output, bool command_changed, const std::vector<std::string>& changed_objects, const std::vector<Explainer::Reason>& relinked_dependencies) const
+{
+    auto node = (cwd() / output).lexically_normal().string();
+
+    if (recorded_hash("@" + output) == 0) {
+        return { .cause = node + " not built before", .chain = { node } };
+    }
+    if (command_changed) {
+        return { .cause = node + " command changed", .chain = { node } };
+    }
+
+    // the output inherits the root cause of the first input that changed
+    if (!changed_objects.empty()) {
+        auto path = (cwd() / changed_objects.front()).lexically_normal().string();
+        auto object_reason = m_object_reasons.find(changed_objects.front());
+        if (object_reason == m_object_reasons.end()) {
+            return { .cause = path + " changed", .chain = { node, path } };
+        }
+        auto reason = object_reason->second;
+        reason.chain.insert(reason.chain.begin(), { node, path });
+        return reason;
+    }
+    if (!relinked_dependencies.empty()) {
+        auto reason = relinked_dependencies.front();
+        reason.chain.insert(reason.chain.begin(), node);
+        return reason;
+    }
+
+    if (!StatCache::the().exists(cwd() / output)) {
+        return { .cause = node + " missing", .chain = { node } };
+    }
+    return { .cause = node + " inputs changed", .chain = { node } };
+}
+
+std::optional<uint64_t> Context::content_hash(const std::filesystem::path& file)
+{
+    auto key = file.lexically_normal().string();
+    auto hash = m_content_hashes.find(key);
+    if (hash != m_content_hashes.end()) {
+        return hash->second;
+    }
+
+    auto content_hash = Hash::File(file);
+    if (content_hash) {
+        m_content_hashes.emplace(std::move(key), *content_hash);
+    }
+    return content_hash;
+}
+
+// The file with all the headers it includes, relative to the context
+std::set<std::string> Context::dependencies(const std::filesystem::path& file)
+{
+    std::set<std::string> dependencies {};
+    std::vector<std::filesystem::path> pending { file };
+    while (!pending.empty()) {
+        auto current = std::move(pending.back());
+        pending.pop_back();
+        if (!dependencies.insert(std::filesystem::proximate(current, cwd()).lexically_normal().string()).second) {
+            continue;
+        }
+        for (auto& include : resolve_includes(current)) {
+            pending.push_back(include);
+        }
+    }
+    return dependencies;
+}
+
+const std::shared_ptr<const ArgvTemplate>& Context::argv_template(const BuildField::ExtensionOption& option)
+{
+    static const std::vector<std::shared_ptr<std::string>> DefaultObjectFlags { std::make_shared<std::string>("-c") };
+    // nasm has never been given -c, its sources keep building as they did until ObjectFlags are set
+    static const std::vector<std::shared_ptr<std::string>> NasmObjectFlags {};
+    auto& argv = m_argv_templates[&option];
+    if (!argv) {
+        auto& default_object_flags = *option.compiler == "nasm" ? NasmObjectFlags : DefaultObjectFlags;
+        argv = ArgvTemplate::Make(*option.compiler, option.flags, option.object_flags.value_or(default_object_flags));
+    }
+    return argv;
+}
+
+// The key covers the compiler, the command and the content of the source with all the headers it includes.
+// Paths are taken relative to the context, so checkouts in different folders share the entries.
+
+std::optional<uint64_t> Context::cache_key(const std::filesystem::path& file, const ArgvTemplate& argv, const char* source, const char* object)
+{
+    std::string compiler = argv.compiler();
+    uint64_t key = Hash::String(compiler, ObjectCache::the().compiler_fingerprint(compiler));
+    argv.for_each_argument(source, object, [&](const char* arg) {
+        key = Hash::Bytes(arg, strlen(arg), key);
+    });
+
+    for (auto& dependency : dependencies(file)) {
+        auto hash = content_hash(cwd() / dependency);
+        if (!hash) {
+            return {};
         }
-        error_builder << path_in_timestamps_file.string() << "\n";
-        trigger_error(error_builder.str());
+        key = Hash::Combine(Hash::String(dependency, key), *hash);
     }
+    return key;
+}
 
-    if (m_include_status[file] != IncludeStatus::NotVisited) {
-        return m_include_status[file];
+const std::vector<std::filesystem::path>& Context::resolve_includes(const std::filesystem::path& file)
+{
+    auto key = file.lexically_normal().string();
+    auto resolved = m_include_graph.find(key);
+    if (resolved != m_include_graph.end()) {
+        return resolved->second;
     }
 
-    auto recursive_include_parser = [&](const std::string& include, bool global) {
+    auto _ = ProfileScope(Profiler::Phase::IncludeScan);
+    std::vector<std::filesystem::path> includes {};
+
+    IncludeParser(file).run([&](const std::string& include, bool global) {
         std::filesystem::path include_path;
 
+        // quoted includes are looked up next to the file first, the ones that can't be found are system
+        // headers or sit in a branch the compiler doesn't take
         if (!global) {
             include_path = file.parent_path() / include;
-            if (!std::filesystem::exists(include_path)) {
-                trigger_error("can\'t find relative include file \"" + include + "\" in " + file.string());
+            if (!StatCache::the().exists(include_path)) {
+                include_path.clear();
             }
-        } else {
-            for (auto& header_folder : m_build.header_folders()) {
-                auto path = directory() / *header_folder / include;
-                if (std::filesystem::exists(path)) {
-                    include_path = path;
-                    break;
-                }
+        }
+        if (include_path.empty()) {
+            if (!m_header_index.built()) {
+                m_header_index.build(directory(), m_build.header_folders());
+            }
+            if (auto path = m_header_index.find(include)) {
+                include_path = std::move(*path);
             }
         }
 
@@ -346,39 +1006,18 @@ IncludeStatus Context::scan_include(const std::filesystem::path& file)
         std::cout << "looking at include: " << include << " from file: " << file << " by path: " << include_path << "\n";
 #endif
 
-        if (include_path.empty()) {
-            return;
-        }
-
-        auto include_status = scan_include(include_path);
-        if (include_status == IncludeStatus::NeedsRecompilation) {
-            m_include_status[file] = IncludeStatus::NeedsRecompilation;
+        if (!include_path.empty()) {
+            includes.push_back(std::move(include_path));
         }
-    };
-
-    m_visited_stack.push_back(path_in_timestamps_file);
-    m_path_to_visited_stack_index[path_in_timestamps_file] = m_visited_stack.size() - 1;
-    IncludeParser(file).run(recursive_include_parser);
-    m_visited_stack.pop_back();
-    m_path_to_visited_stack_index.erase(path_in_timestamps_file);
-
-    if (m_include_status[file] == IncludeStatus::NeedsRecompilation) {
-        return m_include_status[file];
-    }
-
-    if (last_modification_time(file) >= m_timestamps[path_in_timestamps_file]) {
-        m_include_status[file] = IncludeStatus::NeedsRecompilation;
-    } else {
-        m_include_status[file] = IncludeStatus::UpToDate;
-    }
+    });
 
-    return m_include_status[file];
+    return m_include_graph.emplace(std::move(key), std::move(includes)).first->second;
 }
 
 void Context::fill_timestamps()
 {
     TimeStampParser(timestamps_path()).run([&](const std::string& path, int timestamp) {
-        m_timestamps[path] = timestamp;
+        m_timestamps[PathTable::the().id(cwd() / path)] = timestamp;
     });
 }
 
@@ -386,16 +1025,46 @@ void Context::dump_timestamps()
 {
     auto td = TimeStampDumper(timestamps_path());
 
-    for (auto& [path, status] : m_include_status) {
-        if (status == IncludeStatus::NeedsRecompilation) {
-            auto path_in_timestamps_file = std::filesystem::proximate(path, directory());
-            if (!m_failed_sources.contains(path_in_timestamps_file)) {
-                m_timestamps[path_in_timestamps_file] = Config::the().timestamp();
-            }
+    m_include_status.for_each([&](PathTable::Id id, IncludeStatus status) {
+        if (status == IncludeStatus::NeedsRecompilation && !m_failed_sources.get(id)) {
+            m_timestamps[id] = Config::the().timestamp();
         }
+    });
+
+    m_timestamps.for_each([&](PathTable::Id id, int timestamp) {
+        td.append(PathTable::the().relative(id, cwd()), timestamp);
+    });
+}
+
+void Context::fill_compile_times()
+{
+    auto _ = ScopedLocker(m_compile_times_lock);
+    TimeStampParser(compile_times_path()).run([&](const std::string& path, int milliseconds) {
+        m_compile_times[path] = milliseconds;
+    });
+}
+
+void Context::dump_compile_times()
+{
+    auto _ = ScopedLocker(m_compile_times_lock);
+    auto td = TimeStampDumper(compile_times_path());
+    for (auto& [path, milliseconds] : m_compile_times) {
+        td.append(path, milliseconds);
     }
+}
+
+void Context::fill_hashes()
+{
+    HashParser(hashes_path()).run([&](const std::string& path, uint64_t hash) {
+        m_hashes[path] = hash;
+    });
+}
+
+void Context::dump_hashes()
+{
+    auto hd = HashDumper(hashes_path());
 
-    for (auto& [path, timestamp] : m_timestamps) {
-        td.append(path, timestamp);
+    for (auto& [path, hash] : m_hashes) {
+        hd.append(path, hash);
     }
 }
@@ -5,8 +5,12 @@
 
 #pragma once
 
+#include "Executor/ArgvTemplate.h"
 #include "Executor/Executor.h"
+#include "Explainer/Explainer.h"
 #include "Finder/Finder.h"
+#include "Finder/HeaderIndex.h"
+#include "Finder/PathTable.h"
 #include "IncludeParser.h"
 #include "Parser/Parser.h"
 #include "Utils/Lock.h"
@@ -20,14 +24,14 @@
 
 #include <cstdlib>
 #include <filesystem>
+#include <optional>
+#include <set>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
-constexpr size_t path_max = 4096;
-
-enum class IncludeStatus {
+enum class IncludeStatus : uint8_t {
     NotVisited,
     NeedsRecompilation,
     UpToDate,
@@ -36,6 +40,11 @@ enum class IncludeStatus {
 class Context {
     friend class Parser;
     friend class Executor;
+    friend class Watcher;
+    friend class Server;
+    friend class HeaderAnalyzer;
+    friend class ParseCache;
+    friend class NinjaTranslator;
 
 public:
     enum class State {
@@ -53,11 +62,16 @@ public:
 
 public:
     Context(std::filesystem::path path, Operation operation, const DefinesField& defines = {}, bool root_ctx = false);
+    ~Context();
 
     void run();
-    bool run_as_childs(const std::string& pattern, Operation operation);
+    bool run_as_childs(const std::string& pattern, Operation operation, const std::vector<std::string>& exclusions = {});
+    // Runs the files of an Include or Depends list, "line" is where the list is for errors
+    bool spawn_children(const std::vector<std::shared_ptr<std::string>>& patterns, Operation operation, size_t line);
 
     inline bool done() const { return m_done; }
+    inline bool failed() const { return m_state == State::ParseError || m_state == State::BuildError; }
+    inline bool build_finished() const { return m_state == State::Built || failed(); }
     inline Operation operation() const { return m_operation; };
     inline std::filesystem::path directory() const { return m_path.parent_path(); }
     inline std::filesystem::path cwd() const
@@ -80,18 +94,26 @@ public:
     {
         size_t lastindex = m_path.string().find_last_of('.');
         std::string libname = m_path.string().substr(0, lastindex);
-        return (maca_path() / std::filesystem::proximate(libname, directory())).string() + ".a";
+        return (maca_path() / std::filesystem::proximate(libname, cwd())).string() + ".a";
     }
     inline std::string executable_path() const
     {
         size_t lastindex = m_path.string().find_last_of('.');
         std::string libname = m_path.string().substr(0, lastindex);
-        return (maca_path() / std::filesystem::proximate(libname, directory())).string();
+        return (maca_path() / std::filesystem::proximate(libname, cwd())).string();
     }
     inline std::string timestamps_path() const
     {
         return std::filesystem::path(maca_path()) / "timestamps.macainfo";
     }
+    inline std::string hashes_path() const
+    {
+        return std::filesystem::path(maca_path()) / "hashes.macainfo";
+    }
+    inline std::string compile_times_path() const
+    {
+        return std::filesystem::path(maca_path()) / "compile_times.macainfo";
+    }
     inline bool root_ctx() const { return m_root_ctx; }
     inline std::string name() const { return std::filesystem::path(executable_path()).filename(); }
     inline bool root() const { return directory().empty(); }
@@ -99,38 +121,73 @@ public:
     inline const auto& build_field() const { return m_build; }
 
 private:
-    void validate_fields();
+    bool validate_fields();
     bool merge_children();
     bool build();
+    bool fail_build();
+    void run_finalizer(const std::shared_ptr<ExecutableUnit>& finalizer);
+    void update_archive(const std::shared_ptr<ExecutableUnit>& full_archive, const std::vector<std::pair<std::string, uint64_t>>& members);
+    void rerun();
+    void invalidate(const std::filesystem::path& file);
+    void invalidate_sources();
     void fill_timestamps();
     void dump_timestamps();
+    void fill_hashes();
+    void dump_hashes();
+    void fill_compile_times();
+    void dump_compile_times();
+
+    inline uint64_t recorded_hash(const std::string& path) const
+    {
+        auto hash = m_hashes.find(path);
+        return hash == m_hashes.end() ? 0 : hash->second;
+    }
     void process_by_mode();
 
+    const std::vector<std::filesystem::path>& find_sources(const std::string& pattern, const std::vector<std::string>& exclusions);
+    std::vector<std::filesystem::path> collect_sources();
     IncludeStatus scan_include(const std::filesystem::path& file);
+    IncludeStatus scan_include(const std::filesystem::path& file, size_t& lowest_index);
+    Explainer::Reason explain_file(const std::filesystem::path& file) const;
+    Explainer::Reason explain_finalizer(const std::string& output, bool command_changed, const std::vector<std::string>& changed_objects, const std::vector<Explainer::Reason>& relinked_dependencies) const;
+    const std::vector<std::filesystem::path>& resolve_includes(const std::filesystem::path& file);
+    std::set<std::string> dependencies(const std::filesystem::path& file);
+    std::optional<uint64_t> content_hash(const std::filesystem::path& file);
+    const std::shared_ptr<const ArgvTemplate>& argv_template(const BuildField::ExtensionOption& option);
+    std::optional<uint64_t> cache_key(const std::filesystem::path& file, const ArgvTemplate& argv, const char* source, const char* object);
 
     inline void mark_source_as_failed(const std::string& failed_source)
     {
-        m_failed_sources.insert(std::filesystem::proximate(failed_source, directory()));
+        m_failed_sources[PathTable::the().id(failed_source)] = true;
+    }
+
+    inline void record_compile_time(const std::string& source, uint64_t milliseconds)
+    {
+        auto _ = ScopedLocker(m_compile_times_lock);
+        m_compile_times[std::filesystem::proximate(source, cwd()).lexically_normal().string()] = static_cast<int>(milliseconds);
     }
 
-    inline void trigger_error(const std::string& error)
+    // The error is kept, so that the server and watch modes can report it again until the file is fixed
+    inline bool trigger_error(const std::string& error)
     {
-        Log(Color::Red, m_path.string() + ":", error);
-        exit(1);
+        m_error = m_path.string() + ": " + error;
+        Log(Color::Red, m_error);
+        return fail_build();
     }
 
     static inline Context* get_context_by_path(const std::filesystem::path& path)
     {
-        static char resolved_path[path_max];
-        realpath(path.c_str(), resolved_path);
-        return s_processing_contexts[resolved_path];
+        return s_processing_contexts.get(PathTable::the().resolved_id(path));
     }
 
     static inline void register_context(const std::filesystem::path& path, Context* context)
     {
-        static char resolved_path[path_max];
-        realpath(path.c_str(), resolved_path);
-        s_processing_contexts[resolved_path] = context;
+        s_processing_contexts[PathTable::the().resolved_id(path)] = context;
+    }
+
+    static inline void unregister_contexts()
+    {
+        s_processing_contexts.clear();
     }
 
 private:
@@ -139,9 +196,11 @@ private:
     bool m_root_ctx {};
     std::thread* m_thread {};
     State m_state { State::NotStarted };
+    std::string m_error {};
     bool m_done {};
 
-    // Parser
+    // Parser, tokens point into the arena so it has to outlive the parser
+    Arena m_arena {};
     Parser parser {};
     IncludeField m_include {};
     DefinesField m_defines {};
@@ -149,9 +208,19 @@ private:
     BuildField m_build {};
     DefaultField m_default {};
 
+    // Children run while parsing with the defines known at that point, a cached parse repeats them
+    struct Spawn {
+        Operation operation;
+        size_t line;
+        std::vector<std::shared_ptr<std::string>> patterns;
+        DefinesField defines;
+    };
+    std::vector<Spawn> m_spawns {};
+
     // Executor
     std::atomic<int> compile_counter {};
     bool done_finalizer {};
+    size_t m_generation {};
 
     // Children options
     std::vector<Context*> m_children {};
@@ -159,13 +228,41 @@ private:
     // If included context contains a build field it's going to be built separately
     std::vector<BuildField> m_children_builds {};
 
-    bool m_was_any_recompilation {};
-    std::unordered_map<std::string, int> m_timestamps {};
-    std::unordered_map<std::string, IncludeStatus> m_include_status {};
-    std::unordered_set<std::string> m_failed_sources {};
-    std::vector<std::string> m_visited_stack {};
-    std::unordered_map<std::string, size_t> m_path_to_visited_stack_index {};
+    bool m_timestamps_loaded {};
+    // Indexed by PathTable ids
+    PathArray<int> m_timestamps {};
+    PathArray<IncludeStatus> m_include_status {};
+    PathArray<bool> m_failed_sources {};
+
+    // CPU time in milliseconds the last local compilation of every source took
+    SpinLock m_compile_times_lock {};
+    std::unordered_map<std::string, int> m_compile_times {};
+
+    // Explain mode: why files are dirty, either through an include or on their own
+    std::unordered_map<std::string, std::string> m_dirty_includes {};
+    std::unordered_map<std::string, std::string> m_dirty_reasons {};
+    std::unordered_map<std::string, Explainer::Reason> m_object_reasons {};
+    std::optional<Explainer::Reason> m_output_reason {};
+
+    // Content hashes of produced objects / outputs and signatures of finalizer commands
+    std::unordered_map<std::string, uint64_t> m_hashes {};
+    uint64_t m_output_hash {};
+
+    // Compile command lines of the extensions, built on their first compile
+    std::unordered_map<const BuildField::ExtensionOption*, std::shared_ptr<const ArgvTemplate>> m_argv_templates {};
+    // Objects relative to the context by their interned source
+    std::unordered_map<const char*, std::shared_ptr<std::string>> m_object_paths {};
+
+    // Content hashes of sources and headers, computed once per build for the object cache keys
+    std::unordered_map<std::string, uint64_t> m_content_hashes {};
+    std::vector<std::filesystem::path> m_visited_stack {};
+    std::unordered_map<PathTable::Id, size_t> m_path_to_visited_stack_index {};
+
+    // Kept between builds, so that watch mode doesn't rescan unchanged files
+    std::unordered_map<std::string, std::vector<std::filesystem::path>> m_found_sources {};
+    std::unordered_map<std::string, std::vector<std::filesystem::path>> m_include_graph {};
+    HeaderIndex m_header_index {};
 
     static SpinLock m_lock;
-    static std::unordered_map<std::string, Context*> s_processing_contexts;
+    static PathArray<Context*> s_processing_contexts;
 };
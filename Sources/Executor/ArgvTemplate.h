@@ -0,0 +1,57 @@
+/*
+ * ArgvTemplate is the command line shared by all compile units of an extension:
+ * the compiler, its flags, its object flags and "<source> -o <object>". Its strings are interned, so a unit
+ * only carries its source and object, which are put into the two slots right before the fork.
+ */
+
+#pragma once
+
+#include "../Utils/Interner.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ArgvTemplate {
+    // The compiler first and a terminating nullptr last, ready for execvp
+    std::vector<const char*> argv {};
+    size_t source_slot {};
+    size_t object_slot {};
+
+    static std::shared_ptr<const ArgvTemplate> Make(const std::string& compiler, const std::vector<std::shared_ptr<std::string>>& flags, const std::vector<std::shared_ptr<std::string>>& object_flags)
+    {
+        auto made = std::make_shared<ArgvTemplate>();
+        auto& argv = made->argv;
+        argv.push_back(Interner::the().c_str(compiler));
+        for (auto& flag : flags) {
+            argv.push_back(Interner::the().c_str(*flag));
+        }
+        for (auto& flag : object_flags) {
+            argv.push_back(Interner::the().c_str(*flag));
+        }
+        made->source_slot = argv.size();
+        argv.push_back(nullptr);
+        argv.push_back("-o");
+        made->object_slot = argv.size();
+        argv.push_back(nullptr);
+        argv.push_back(nullptr);
+        return made;
+    }
+
+    const char* compiler() const { return argv.front(); }
+
+    // Calls back with every argument after the compiler, the slots filled in
+    template <typename Callback>
+    void for_each_argument(const char* source, const char* object, Callback callback) const
+    {
+        for (size_t at = 1; at + 1 < argv.size(); at++) {
+            auto argument = argv[at];
+            if (at == source_slot) {
+                argument = source;
+            } else if (at == object_slot) {
+                argument = object;
+            }
+            callback(argument);
+        }
+    }
+};
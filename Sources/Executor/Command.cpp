@@ -1,23 +1,27 @@
 #include "Command.h"
+#include "../Utils/Utils.h"
 
 #include <array>
 #include <fcntl.h>
 #include <filesystem>
+#include <csignal>
 #include <iostream>
 #include <unistd.h>
 #include <vector>
-#include <sys/wait.h> 
+#include <sys/resource.h>
+#include <sys/wait.h>
 
 void Command::open_descriptors()
 {
     // opening stdout file descriptors
-    int res = pipe(m_out_fds);
+    // (close-on-exec keeps them from leaking into compilers, dup2 clears the flag for stdout / stderr)
+    int res = pipe2(m_out_fds, O_CLOEXEC);
     if (res < 0) {
         exit(1);
     }
 
     // opening stderr file descriptors
-    res = pipe(m_err_fds);
+    res = pipe2(m_err_fds, O_CLOEXEC);
     if (res < 0) {
         exit(1);
     }
@@ -33,20 +37,43 @@ void Command::open_descriptors()
 
 void Command::execute(const std::string& compiler, const std::vector<std::shared_ptr<std::string>>& args, const std::filesystem::path& cwd)
 {
-    std::vector<char*> cmd_args {};
-    cmd_args.push_back(const_cast<char*>(compiler.data()));
+    m_argv.clear();
+    m_argv.push_back(const_cast<char*>(compiler.data()));
 
     for (auto& arg : args) {
-        cmd_args.push_back(arg->data());
+        m_argv.push_back(arg->data());
     }
 
-    cmd_args.push_back(nullptr);
+    m_argv.push_back(nullptr);
+    spawn(cwd);
+}
+
+void Command::execute(const ArgvTemplate& argv, const char* source, const char* object, const std::filesystem::path& cwd)
+{
+    m_argv.resize(argv.argv.size());
+    for (size_t at = 0; at < m_argv.size(); at++) {
+        m_argv[at] = const_cast<char*>(argv.argv[at]);
+    }
+    m_argv[argv.source_slot] = const_cast<char*>(source);
+    m_argv[argv.object_slot] = const_cast<char*>(object);
+    spawn(cwd);
+}
 
+void Command::start()
+{
     m_fetched = false;
     m_done = false;
+    m_cancelled = false;
     m_exit_status = 0;
-    m_std_out.clear();
-    m_std_err.clear();
+    m_cpu_time = 0;
+    m_started = std::chrono::steady_clock::now();
+    m_std_out.reset(JobOutput::LogPath(*m_executable_unit, "stdout"));
+    m_std_err.reset(JobOutput::LogPath(*m_executable_unit, "stderr"));
+}
+
+void Command::spawn(const std::filesystem::path& cwd)
+{
+    start();
 
     m_command_pid = fork();
     if (m_command_pid < 0) {
@@ -61,7 +88,56 @@ void Command::execute(const std::string& compiler, const std::vector<std::shared
             exit(1);
         }
         std::filesystem::current_path(cwd);
-        execvp(cmd_args[0], cmd_args.data());
+        execvp(m_argv[0], m_argv.data());
+    }
+}
+
+void Command::execute_remotely(const std::shared_ptr<ExecutableUnit>& unit)
+{
+    start();
+    m_remote_done = false;
+    m_remote_failed = false;
+
+    m_remote_thread = new std::thread([this, unit]() {
+        WorkerProtocol::CompileResult result {};
+        if (!Dispatcher::Compile(*m_worker, *unit, result)) {
+            m_remote_failed = true;
+            m_remote_done = true;
+            return;
+        }
+
+        m_exit_status = result.status;
+        m_std_out.append(result.std_out.data(), result.std_out.size());
+        m_std_err.append(result.std_err.data(), result.std_err.size());
+        m_std_out.close();
+        m_std_err.close();
+
+        if (!result.status) {
+            auto object = unit->cwd / *unit->binary;
+            unlink(object.c_str());
+            int fd = open(object.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            bool written = fd >= 0 && Utils::WriteAll(fd, result.object.data(), result.object.size());
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (!written) {
+                m_remote_failed = true;
+            }
+        }
+        m_remote_done = true;
+    });
+}
+
+void Command::cancel()
+{
+    if (m_done || m_cancelled) {
+        return;
+    }
+    m_cancelled = true;
+
+    // a remote compilation can't be stopped, its result is ignored
+    if (!m_worker) {
+        kill(m_command_pid, SIGKILL);
     }
 }
 
@@ -71,11 +147,24 @@ bool Command::done()
         return true;
     }
 
+    if (m_worker) {
+        if (!m_remote_done) {
+            return false;
+        }
+        m_remote_thread->join();
+        delete m_remote_thread;
+        m_remote_thread = nullptr;
+        m_done = true;
+        return true;
+    }
+
     int status = 0;
-    int res = waitpid(m_command_pid, &status, WNOHANG);
+    struct rusage usage {};
+    int res = wait4(m_command_pid, &status, WNOHANG, &usage);
 
     // command is running
     if (res == 0) {
+        read_output();
         return false;
     }
 
@@ -89,7 +178,19 @@ bool Command::done()
         m_exit_status = WEXITSTATUS(status);
     }
 
-    auto buffer = std::array<char, 256>();
+    m_cpu_time = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+
+    read_output();
+    m_std_out.close();
+    m_std_err.close();
+
+    m_done = true;
+    return true;
+}
+
+void Command::read_output()
+{
+    auto buffer = std::array<char, 16 * 1024>();
 
     while (true) {
         int out_bytes = read(m_out_fds[read_ptr], buffer.data(), buffer.size());
@@ -106,7 +207,4 @@ bool Command::done()
         }
         m_std_err.append(buffer.data(), err_bytes);
     }
-
-    m_done = true;
-    return true;
 }
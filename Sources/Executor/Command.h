@@ -1,11 +1,16 @@
 #pragma once
 
+#include "Dispatcher.h"
 #include "ExecutableUnit.h"
+#include "JobOutput.h"
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <unistd.h>
 #include <filesystem>
+#include <thread>
 
 class Command {
 public:
@@ -14,33 +19,61 @@ public:
 
 public:
     void execute(const std::string& compiler, const std::vector<std::shared_ptr<std::string>>& args, const std::filesystem::path& cwd);
+    void execute(const ArgvTemplate& argv, const char* source, const char* object, const std::filesystem::path& cwd);
+    // Sends the compile unit to the worker of the slot and writes the object it returns
+    void execute_remotely(const std::shared_ptr<ExecutableUnit>& unit);
     bool done();
 
 public:
     bool fetched() const { return m_fetched; }
     void fetch() { m_fetched = true; }
+    void cancel();
+    bool cancelled() const { return m_cancelled; }
+    // The worker couldn't deliver, the unit has to run locally
+    bool remote_failed() const { return m_remote_failed; }
     int exit_status() const { return m_exit_status; }
+    // User and system time spent by the command, in milliseconds
+    uint64_t cpu_time() const { return m_cpu_time; }
+    // When the command was handed to its slot
+    std::chrono::steady_clock::time_point started() const { return m_started; }
 
-    std::string& std_out() { return m_std_out; }
-    const std::string& std_out() const { return m_std_out; }
-
-    std::string& std_err() { return m_std_err; }
-    const std::string& std_err() const { return m_std_err; }
+    const JobOutput& std_out() const { return m_std_out; }
+    const JobOutput& std_err() const { return m_std_err; }
 
     auto executable_unit() { return m_executable_unit; }
     void set_executable_unit(const std::shared_ptr<ExecutableUnit>& unit) { m_executable_unit = unit; }
 
+    Dispatcher::Worker* worker() const { return m_worker; }
+    void set_worker(Dispatcher::Worker* worker) { m_worker = worker; }
+
+private:
+    void spawn(const std::filesystem::path& cwd);
+    void start();
+    // Reads what the command wrote so far, a full pipe would block it
+    void read_output();
+
 private:
     std::shared_ptr<ExecutableUnit> m_executable_unit {};
+    // Reused by every execution of the slot
+    std::vector<char*> m_argv {};
     int m_command_pid { -1 };
     bool m_done { true };
     bool m_fetched { true };
+    bool m_cancelled {};
     int8_t m_exit_status {};
+    uint64_t m_cpu_time {};
+    std::chrono::steady_clock::time_point m_started {};
 
     int m_out_fds[2] {};
     int m_err_fds[2] {};
     constexpr static auto read_ptr = 0, write_ptr = 1;
 
-    std::string m_std_out {};
-    std::string m_std_err {};
+    JobOutput m_std_out {};
+    JobOutput m_std_err {};
+
+    // Remote slots run their units on a thread waiting for the worker
+    Dispatcher::Worker* m_worker {};
+    std::thread* m_remote_thread {};
+    std::atomic<bool> m_remote_done {};
+    bool m_remote_failed {};
 };
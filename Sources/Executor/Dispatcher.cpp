@@ -0,0 +1,104 @@
+#include "Dispatcher.h"
+#include "../Config.h"
+#include "../Utils/Logger.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace WorkerProtocol;
+
+static constexpr auto default_connect_timeout_ms = 2000;
+static constexpr auto default_compile_timeout_ms = 300000;
+
+bool Dispatcher::enabled() const
+{
+    auto flag = Config::the().flags().find("workers");
+    return flag != Config::the().flags().end() && !flag->second.empty();
+}
+
+void Dispatcher::connect_workers()
+{
+    m_workers.clear();
+    if (!enabled()) {
+        return;
+    }
+
+    auto timeout = Config::the().int_flag("worker-timeout", default_connect_timeout_ms);
+    for (auto& address : Utils::Split(Config::the().flags()["workers"], ",")) {
+        auto colon = address.rfind(':');
+        auto worker = std::make_unique<Worker>();
+        worker->host = address.substr(0, colon);
+        worker->port = colon == std::string::npos ? "8585" : address.substr(colon + 1);
+
+        int fd = Socket::Connect(worker->host, worker->port, timeout);
+        if (fd >= 0) {
+            Socket::SetTimeout(fd, timeout);
+            Writer writer {};
+            writer.u32(Magic);
+            writer.u32(static_cast<uint32_t>(Request::Slots));
+            Reader reader(fd);
+            if (writer.send(fd)) {
+                worker->slots = reader.u32();
+            }
+            if (!reader.ok()) {
+                worker->slots = 0;
+            }
+            close(fd);
+        }
+
+        if (!worker->slots) {
+            Log(Color::Yellow, "Worker", worker->name(), "is unreachable");
+            continue;
+        }
+        Log(Color::Magenta, "Compiling on", worker->name(), "with", worker->slots, "slots");
+        m_workers.push_back(std::move(worker));
+    }
+}
+
+bool Dispatcher::Compile(Worker& worker, const ExecutableUnit& unit, CompileResult& result)
+{
+    CompileJob job {};
+    job.command.push_back(*unit.callee);
+    if (unit.argv) {
+        unit.argv->for_each_argument(unit.source_arg, unit.binary->c_str(), [&](const char* arg) {
+            job.command.emplace_back(arg);
+        });
+    }
+    for (auto& arg : unit.args) {
+        job.command.push_back(*arg);
+    }
+    job.output = *unit.binary;
+
+    for (auto& input : unit.inputs) {
+        auto path = unit.cwd / input;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        std::string content(lseek(fd, 0, SEEK_END), '\0');
+        bool read = pread(fd, content.data(), content.size(), 0) == static_cast<ssize_t>(content.size());
+        close(fd);
+        if (!read) {
+            return false;
+        }
+        job.files.emplace_back(input, std::move(content));
+    }
+
+    int fd = Socket::Connect(worker.host, worker.port, Config::the().int_flag("worker-timeout", default_connect_timeout_ms));
+    if (fd < 0) {
+        return false;
+    }
+    // a worker that hangs or drops off the network fails like one that resets the connection
+    Socket::SetTimeout(fd, Config::the().int_flag("worker-compile-timeout", default_compile_timeout_ms));
+
+    bool done = SendJob(fd, job) && ReceiveResult(fd, result);
+    close(fd);
+    return done;
+}
+
+void Dispatcher::WorkerFailed(Worker& worker)
+{
+    if (!worker.failed.exchange(true)) {
+        Log(Color::Yellow, "Worker", worker.name(), "failed, its units are compiled locally");
+    }
+}
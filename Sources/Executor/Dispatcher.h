@@ -0,0 +1,49 @@
+/*
+ * Dispatcher sends compile units to the MacaWorker daemons listed with "-workers~host:port,host:port".
+ * Every worker gets as many Executor slots as it reports, units a worker fails to deliver or to compile are compiled locally.
+ */
+
+#pragma once
+
+#include "../Worker/Protocol.h"
+#include "ExecutableUnit.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Dispatcher {
+public:
+    struct Worker {
+        std::string host {};
+        std::string port {};
+        uint32_t slots {};
+        std::atomic<bool> failed {};
+
+        inline std::string name() const { return host + ":" + port; }
+    };
+
+public:
+    static Dispatcher& the()
+    {
+        static auto instance = Dispatcher();
+        return instance;
+    }
+
+    bool enabled() const;
+
+    // Asks every listed worker for its slot count, unreachable ones are skipped
+    void connect_workers();
+    inline const std::vector<std::unique_ptr<Worker>>& workers() const { return m_workers; }
+
+    // Blocks until the worker replies, false if it couldn't compile the unit
+    static bool Compile(Worker& worker, const ExecutableUnit& unit, WorkerProtocol::CompileResult& result);
+    static void WorkerFailed(Worker& worker);
+
+private:
+    Dispatcher() = default;
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers {};
+};
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "ArgvTemplate.h"
+
 #include <memory>
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <optional>
 
 enum class Operation {
     Compile,
@@ -12,6 +15,7 @@ enum class Operation {
 };
 
 class Context;
+struct RemoteFetch;
 
 struct ExecutableUnit {
     Operation op {};
@@ -20,5 +24,18 @@ struct ExecutableUnit {
     std::string src {};
     std::shared_ptr<std::string> binary;
     std::vector<std::shared_ptr<std::string>> args {};
+    // Compile units run their extension's command line instead of args, with the interned source and the binary filled in
+    std::shared_ptr<const ArgvTemplate> argv {};
+    const char* source_arg {};
     std::filesystem::path cwd {};
+    size_t generation {};
+
+    // Compiled objects are stored in the object cache under this key
+    std::optional<uint64_t> cache_key {};
+    // Download of the object from the remote cache, racing the compilation
+    std::shared_ptr<RemoteFetch> remote {};
+    // Source and headers of a compile unit relative to cwd, shipped to the workers
+    std::vector<std::string> inputs {};
+    // Failed on a worker, compiled again locally
+    bool local_only {};
 };
@@ -1,30 +1,91 @@
 #include "Executor.h"
+#include "../Cache/ObjectCache.h"
 #include "../Config.h"
 #include "../Context.h"
+#include "../Profiler/Profiler.h"
 #include "../Utils/Logger.h"
+#include "Dispatcher.h"
 #include "ExecutableUnit.h"
+#include "JobOutput.h"
 
-#include <iostream>
 #include <thread>
 
 void Executor::run()
 {
+    // workers add their slots after the local ones
+    Dispatcher::the().connect_workers();
+    size_t slots = m_free_processes;
+    for (auto& worker : Dispatcher::the().workers()) {
+        slots += worker->slots;
+    }
+    m_commands = std::vector<Command>(slots);
+    size_t remote_slot = m_free_processes;
+    for (auto& worker : Dispatcher::the().workers()) {
+        for (size_t at = 0; at < worker->slots; at++) {
+            m_commands[remote_slot++].set_worker(worker.get());
+        }
+    }
+
     m_thread = new std::thread([this]() {
         for (size_t cpu = 0; cpu < m_free_processes; cpu++) {
             m_commands[cpu].open_descriptors();
         }
 
-        const auto fetch_command = [](Command& cmd) {
+        const auto fetch_command = [this](Command& cmd) {
+            if (cmd.remote_failed() && !cmd.cancelled()) {
+                Dispatcher::WorkerFailed(*cmd.worker());
+                m_units.enqueue(cmd.executable_unit());
+                cmd.fetch();
+                return;
+            }
+
+            auto& remote = cmd.executable_unit()->remote;
+            if (remote && !stale(*cmd.executable_unit()) && ObjectCache::SettledRemotely(*remote)) {
+                finish_remotely(cmd.executable_unit());
+                cmd.fetch();
+                return;
+            }
+
+            if (cmd.cancelled()) {
+                discard_unit(cmd.executable_unit());
+                cmd.fetch();
+                return;
+            }
+
+            // a worker can lack what the source needs, only a local compiler can report a build error
+            if (cmd.worker() && cmd.exit_status()) {
+                cmd.executable_unit()->local_only = true;
+                m_units.enqueue(cmd.executable_unit());
+                cmd.fetch();
+                return;
+            }
+
+            // the slots are polled, so a job lasts until the first poll after it's done
+            if (Profiler::the().enabled()) {
+                Profiler::the().record(Profiler::Phase::Job, std::chrono::steady_clock::now() - cmd.started());
+            }
+
             if (cmd.executable_unit()->op == Operation::Compile) {
+                auto built = cmd.worker() ? cmd.executable_unit()->src + " (on " + cmd.worker()->name() + ")" : cmd.executable_unit()->src;
                 if (cmd.exit_status()) {
-                    Log(Color::Red, "Build error:", cmd.executable_unit()->src);
+                    Log(Color::Red, "Build error:", built);
                     cmd.executable_unit()->ctx->m_state = Context::State::BuildError;
                     cmd.executable_unit()->ctx->mark_source_as_failed(cmd.executable_unit()->src);
                 } else {
                     if (!cmd.std_out().empty() || !cmd.std_err().empty()) {
-                        Log(Color::Yellow, "Built with warnings:", cmd.executable_unit()->src);
+                        Log(Color::Yellow, "Built with warnings:", built);
                     } else {
-                        Log(Color::Green, "Built:", cmd.executable_unit()->src);
+                        LogProgress(Color::Green, "Built:", built);
+                    }
+
+                    // remote compilations don't report their CPU time
+                    if (!cmd.worker()) {
+                        cmd.executable_unit()->ctx->record_compile_time(cmd.executable_unit()->src, cmd.cpu_time());
+                    }
+
+                    if (auto& key = cmd.executable_unit()->cache_key) {
+                        auto& unit = *cmd.executable_unit();
+                        ObjectCache::the().store(*key, unit.cwd / *unit.binary, cmd.std_out().text(), cmd.std_err().text(), cmd.cpu_time());
                     }
                 }
 
@@ -39,7 +100,7 @@ void Executor::run()
                     if (!cmd.std_out().empty() || !cmd.std_err().empty()) {
                         Log(Color::Yellow, finalized, "with warnings:", *cmd.executable_unit()->binary);
                     } else {
-                        Log(Color::Green, finalized + ":", *cmd.executable_unit()->binary);
+                        LogProgress(Color::Green, finalized + ":", *cmd.executable_unit()->binary);
                     }
                 }
 
@@ -47,43 +108,82 @@ void Executor::run()
             }
 
             if (!cmd.std_out().empty()) {
-                std::cout << cmd.std_out() << "\n";
+                LogOutput(cmd.std_out().console());
             }
 
             if (!cmd.std_err().empty()) {
-                std::cout << cmd.std_err() << "\n";
+                LogOutput(cmd.std_err().console());
             }
 
+            Logger::the().finish_job();
+
             cmd.fetch();
         };
 
         std::shared_ptr<ExecutableUnit> unit {};
 
-        while (m_running || m_units.size_approx()) {
-            int fetched = -1;
+        while (m_running || m_units.size_approx() || unit) {
+            int free_local = -1;
+            int free_remote = -1;
 
             for (size_t at = 0; at < m_commands.size(); at++) {
                 auto& cmd = m_commands[at];
 
+                if (!cmd.fetched() && stale(*cmd.executable_unit())) {
+                    cmd.cancel();
+                }
+
+                // the object was downloaded first, the compiler isn't needed anymore
+                if (!cmd.fetched() && cmd.executable_unit()->remote && cmd.executable_unit()->remote->state == RemoteFetch::State::Fetched) {
+                    cmd.cancel();
+                }
+
                 if (cmd.done() && !cmd.fetched()) {
                     fetch_command(cmd);
                 }
 
                 if (cmd.fetched()) {
-                    fetched = at;
+                    if (!cmd.worker()) {
+                        free_local = at;
+                    } else if (!cmd.worker()->failed) {
+                        free_remote = at;
+                    }
                 }
             }
 
-            if (fetched < 0) {
+            if (free_local < 0 && free_remote < 0) {
                 continue;
             }
 
-            if (!m_units.dequeue(unit)) {
+            // a unit is held while only the slots it can't run on are free
+            if (!unit && !m_units.dequeue(unit)) {
                 std::this_thread::yield();
                 continue;
             }
 
-            process_unit(unit, m_commands[fetched]);
+            if (stale(*unit)) {
+                discard_unit(unit);
+                unit = nullptr;
+                continue;
+            }
+
+            if (unit->remote && unit->remote->state == RemoteFetch::State::Fetched && ObjectCache::SettledRemotely(*unit->remote)) {
+                finish_remotely(unit);
+                unit = nullptr;
+                continue;
+            }
+
+            // only compile units can leave the machine
+            int slot = free_local;
+            if (slot < 0 && unit->op == Operation::Compile && !unit->local_only) {
+                slot = free_remote;
+            }
+            if (slot < 0) {
+                continue;
+            }
+
+            process_unit(unit, m_commands[slot]);
+            unit = nullptr;
         }
 
         for (auto& cmd : m_commands) {
@@ -98,6 +198,8 @@ void Executor::run()
 
 void Executor::enqueue(const std::shared_ptr<ExecutableUnit>& unit)
 {
+    unit->generation = unit->ctx->m_generation;
+    Logger::the().add_job();
     if (unit->op == Operation::Compile) {
         unit->ctx->compile_counter++;
     }
@@ -112,5 +214,51 @@ void Executor::await()
 void Executor::process_unit(const std::shared_ptr<ExecutableUnit>& unit, Command& cmd)
 {
     cmd.set_executable_unit(unit);
-    cmd.execute(*unit->callee, unit->args, unit->cwd);
+    if (cmd.worker()) {
+        cmd.execute_remotely(unit);
+    } else if (unit->argv) {
+        cmd.execute(*unit->argv, unit->source_arg, unit->binary->c_str(), unit->cwd);
+    } else {
+        cmd.execute(*unit->callee, unit->args, unit->cwd);
+    }
+}
+
+void Executor::finish_remotely(const std::shared_ptr<ExecutableUnit>& unit)
+{
+    auto& entry = unit->remote->entry;
+    if (!entry.std_out.empty() || !entry.std_err.empty()) {
+        Log(Color::Yellow, "Downloaded with warnings:", unit->src);
+    } else {
+        LogProgress(Color::Green, "Downloaded:", unit->src);
+    }
+
+    // replayed even if empty, so that the logs of a previous run are removed
+    auto std_out = JobOutput::Console(entry.std_out, JobOutput::LogPath(*unit, "stdout"));
+    auto std_err = JobOutput::Console(entry.std_err, JobOutput::LogPath(*unit, "stderr"));
+    if (!std_out.empty()) {
+        LogOutput(std_out);
+    }
+    if (!std_err.empty()) {
+        LogOutput(std_err);
+    }
+    Logger::the().finish_job();
+
+    unit->ctx->compile_counter--;
+}
+
+void Executor::discard_unit(const std::shared_ptr<ExecutableUnit>& unit)
+{
+    if (unit->remote) {
+        ObjectCache::DropRemote(*unit->remote);
+    }
+
+    Logger::the().finish_job();
+    unit->ctx->m_state = Context::State::BuildError;
+    if (unit->op == Operation::Compile) {
+        // the object might be half-written, so the source mustn't be recorded as built
+        unit->ctx->mark_source_as_failed(unit->src);
+        unit->ctx->compile_counter--;
+    } else {
+        unit->ctx->done_finalizer = true;
+    }
 }
@@ -27,10 +27,16 @@ public:
     void await();
     void enqueue(const std::shared_ptr<ExecutableUnit>& u3);
 
+    // Makes all the enqueued and running units stale: they are dropped
+    // and their contexts fail the build they were enqueued by.
+    inline void cancel() { m_generation++; }
+    inline size_t generation() const { return m_generation; }
+
     // Blocking command
     static inline void blocking_cmd(const std::string& cmd)
     {
         Log(Color::Blue, "Command:", cmd);
+        Logger::the().flush();
         system(cmd.c_str());
     }
 
@@ -39,11 +45,15 @@ private:
 
 private:
     static void process_unit(const std::shared_ptr<ExecutableUnit>& u3, Command& cmd);
+    static void finish_remotely(const std::shared_ptr<ExecutableUnit>& u3);
+    static void discard_unit(const std::shared_ptr<ExecutableUnit>& u3);
+    inline bool stale(const ExecutableUnit& unit) const { return unit.generation != m_generation; }
 
 private:
     std::thread* m_thread {};
     bool m_running { true };
+    std::atomic<size_t> m_generation {};
     size_t m_free_processes { std::max((uint32_t)1, std::thread::hardware_concurrency()) };
-    std::vector<Command> m_commands { std::vector<Command>(m_free_processes) };
+    std::vector<Command> m_commands {};
     ThreadQueue<std::shared_ptr<ExecutableUnit>> m_units {};
 };
@@ -0,0 +1,154 @@
+#include "JobOutput.h"
+
+#include "../Config.h"
+#include "../Utils/Utils.h"
+#include "ExecutableUnit.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <string_view>
+#include <unistd.h>
+
+void JobOutput::reset(std::string log_path)
+{
+    close();
+    m_log_path = std::move(log_path);
+    // the log of the previous run is stale even if this one is too short to be spilled
+    if (!m_log_path.empty()) {
+        unlink(m_log_path.c_str());
+    }
+    m_cap = static_cast<size_t>(std::max(Config::the().int_flag("log-size", 4096), 0)) << 10;
+    m_spilled = false;
+    m_log_failed = false;
+    m_size = 0;
+    m_logged = 0;
+    m_head.clear();
+    m_tail.clear();
+}
+
+void JobOutput::append(const char* data, size_t size)
+{
+    m_size += size;
+    if (m_head.size() < ConsoleHead) {
+        auto taken = std::min(size, ConsoleHead - m_head.size());
+        m_head.append(data, taken);
+        data += taken;
+        size -= taken;
+    }
+    if (!size) {
+        return;
+    }
+
+    m_tail.append(data, size);
+    if (m_spilled) {
+        if (m_fd >= 0 && m_logged < m_cap) {
+            auto logged = std::min(size, m_cap - m_logged);
+            Utils::WriteAll(m_fd, data, logged);
+            m_logged += logged;
+        }
+    } else if (m_size > ConsoleHead + ConsoleTail) {
+        spill();
+    }
+
+    if (m_spilled && m_tail.size() > 2 * ConsoleTail) {
+        m_tail.erase(0, m_tail.size() - ConsoleTail);
+    }
+}
+
+void JobOutput::spill()
+{
+    // the tail is trimmed from now on, even if the log can't be written
+    m_spilled = true;
+
+    std::error_code error {};
+    std::filesystem::create_directories(std::filesystem::path(m_log_path).parent_path(), error);
+    m_fd = open(m_log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        m_log_failed = true;
+        return;
+    }
+
+    for (auto* part : { &m_head, &m_tail }) {
+        auto logged = std::min(part->size(), m_cap - m_logged);
+        Utils::WriteAll(m_fd, part->data(), logged);
+        m_logged += logged;
+    }
+}
+
+void JobOutput::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+std::string JobOutput::text() const
+{
+    if (!m_spilled) {
+        return m_head + m_tail;
+    }
+
+    int fd = open(m_log_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return console();
+    }
+    std::string text(m_logged, '\0');
+    bool read = Utils::ReadAll(fd, text.data(), text.size());
+    ::close(fd);
+    return read ? text : console();
+}
+
+std::string JobOutput::console() const
+{
+    if (!m_spilled) {
+        return m_head + m_tail;
+    }
+
+    // cut at line ends, so no diagnostic is shown half
+    std::string_view head = m_head;
+    std::string_view tail = m_tail;
+    if (tail.size() > ConsoleTail) {
+        tail.remove_prefix(tail.size() - ConsoleTail);
+    }
+    if (auto end = head.rfind('\n'); end != std::string_view::npos) {
+        head = head.substr(0, end + 1);
+    }
+    if (auto start = tail.find('\n'); start != std::string_view::npos && start + 1 < tail.size()) {
+        tail.remove_prefix(start + 1);
+    }
+
+    std::string text(head);
+    if (!text.ends_with('\n')) {
+        text += '\n';
+    }
+    text += "... " + std::to_string(m_size - head.size() - tail.size()) + " bytes left out, ";
+    if (m_log_failed) {
+        text += "the log couldn't be written to " + m_log_path;
+    } else if (m_logged < m_size) {
+        text += "the first " + std::to_string(m_logged) + " bytes are in " + m_log_path;
+    } else {
+        text += "the whole output is in " + m_log_path;
+    }
+    text += " ...\n";
+    text += tail;
+    return text;
+}
+
+std::string JobOutput::Console(const std::string& text, const std::string& log_path)
+{
+    // short output is kept as it is, the reset only removes the stale log
+    JobOutput output {};
+    output.reset(log_path);
+    output.append(text.data(), text.size());
+    return output.console();
+}
+
+// Named after the output of the unit, every job replaces or removes the log of its previous run
+std::string JobOutput::LogPath(const ExecutableUnit& unit, const char* stream)
+{
+    auto name = (unit.cwd / *unit.binary).lexically_normal().string();
+    std::replace(name.begin(), name.end(), '/', '_');
+    return (std::filesystem::path(LogsFolder) / (name + "." + stream + ".log")).string();
+}
@@ -0,0 +1,58 @@
+/*
+ * JobOutput collects one stream of a job's output with bounded memory: only the head and
+ * the tail are kept for the console. Once the output outgrows them it's spilled into a
+ * log under MacaBuild/logs/, up to the -log-size~<KiB> cap, where the full text stays.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+struct ExecutableUnit;
+
+class JobOutput {
+public:
+    static constexpr auto LogsFolder = "MacaBuild/logs";
+    static constexpr size_t ConsoleHead = 4096;
+    static constexpr size_t ConsoleTail = 4096;
+
+public:
+    JobOutput() = default;
+    ~JobOutput() { close(); }
+    JobOutput(const JobOutput&) = delete;
+    JobOutput& operator=(const JobOutput&) = delete;
+
+    // Starts collecting a new job's output, the log isn't created unless it's needed
+    void reset(std::string log_path);
+    void append(const char* data, size_t size);
+    void close();
+
+    bool empty() const { return !m_size; }
+    size_t size() const { return m_size; }
+
+    // The whole output, read back from the log if it didn't fit into memory
+    std::string text() const;
+    // Head and tail with a pointer to the log between them if anything was left out
+    std::string console() const;
+
+    // The same for output replayed from the cache, which is spilled as a whole if it's long.
+    // The log of the previous run is removed even if the output is short or empty.
+    static std::string Console(const std::string& text, const std::string& log_path);
+    static std::string LogPath(const ExecutableUnit& unit, const char* stream);
+
+private:
+    void spill();
+
+private:
+    std::string m_log_path {};
+    int m_fd { -1 };
+    size_t m_cap {};
+    bool m_spilled {};
+    bool m_log_failed {};
+    size_t m_size {};
+    size_t m_logged {};
+    std::string m_head {};
+    // trimmed to ConsoleTail once it's twice as long
+    std::string m_tail {};
+};
@@ -0,0 +1,68 @@
+#include "Explainer.h"
+
+#include "../Config.h"
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+bool Explainer::enabled() const
+{
+    return Config::the().flags().contains("explain");
+}
+
+void Explainer::record(Reason reason)
+{
+    auto _ = ScopedLocker(m_lock);
+    m_reasons.push_back(std::move(reason));
+}
+
+void Explainer::report()
+{
+    std::vector<Reason> reasons {};
+    {
+        auto _ = ScopedLocker(m_lock);
+        reasons.swap(m_reasons);
+    }
+
+    if (!enabled()) {
+        return;
+    }
+
+    if (reasons.empty()) {
+        Log(Color::Magenta, "Explain: nothing was rebuilt");
+        return;
+    }
+
+    // causes keep the order they were first seen in, so equal counts are reported stably
+    std::vector<std::string> causes {};
+    std::unordered_map<std::string, std::vector<const Reason*>> nodes {};
+    for (auto& reason : reasons) {
+        auto& cause_nodes = nodes[reason.cause];
+        if (cause_nodes.empty()) {
+            causes.push_back(reason.cause);
+        }
+        cause_nodes.push_back(&reason);
+    }
+
+    std::stable_sort(causes.begin(), causes.end(), [&](const std::string& a, const std::string& b) {
+        return nodes[a].size() > nodes[b].size();
+    });
+
+    Log(Color::Magenta, "Explain:", reasons.size(), reasons.size() == 1 ? "node rebuilt" : "nodes rebuilt");
+    for (auto& cause : causes) {
+        auto& cause_nodes = nodes[cause];
+        Log(Color::Magenta, " ", cause_nodes.size(), cause_nodes.size() == 1 ? "rebuild," : "rebuilds,", cause);
+
+        for (size_t at = 0; at < std::min(cause_nodes.size(), ExamplesPerCause); at++) {
+            std::string chain {};
+            for (auto& node : cause_nodes[at]->chain) {
+                chain += chain.empty() ? node : " <- " + node;
+            }
+            Log(Color::Blue, "   ", chain);
+        }
+        if (cause_nodes.size() > ExamplesPerCause) {
+            Log(Color::Blue, "    ... and", cause_nodes.size() - ExamplesPerCause, "more");
+        }
+    }
+}
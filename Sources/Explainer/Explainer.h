@@ -0,0 +1,46 @@
+/*
+ * Explainer records why every node of a build is rebuilt ("-explain").
+ * Once the build is over, the reasons are grouped by their root cause,
+ * so the change responsible for most of the rebuilds is reported first.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <string>
+#include <vector>
+
+class Explainer {
+public:
+    struct Reason {
+        // e.g. "include/config.h modified since the last build"
+        std::string cause {};
+        // from the rebuilt node down to the file the cause is about
+        std::vector<std::string> chain {};
+    };
+
+    // Chains printed for every cause, the rest are only counted
+    static constexpr size_t ExamplesPerCause = 5;
+
+public:
+    static Explainer& the()
+    {
+        static auto instance = Explainer();
+        return instance;
+    }
+
+    bool enabled() const;
+
+    void record(Reason reason);
+
+    // Prints the reasons recorded since the last report
+    void report();
+
+private:
+    Explainer() = default;
+
+private:
+    SpinLock m_lock {};
+    std::vector<Reason> m_reasons {};
+};
@@ -2,9 +2,11 @@
 
 #include "../Utils/Utils.h"
 #include "Glob.h"
+#include "StatCache.h"
 
 #include <algorithm>
 #include <filesystem>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -18,16 +20,33 @@ public:
     {
         return Glob(MacaExtensionPattern).result();
     }
-    static inline auto FindMacaFiles(const std::string& directory, const std::string& pattern = "")
+    static inline auto FindMacaFiles(const std::string& directory, const std::string& pattern = "", const std::vector<std::string>& exclusions = {})
     {
         auto path = std::filesystem::path(directory) / std::filesystem::path(pattern) / MacaExtensionPattern;
-        return Glob(path).result();
+        return Glob(path, exclusions).result();
     }
 
-    static inline auto FindFiles(const std::string& directory, const std::string& pattern)
+    static inline auto FindFiles(const std::string& directory, const std::string& pattern, const std::vector<std::string>& exclusions = {})
     {
         auto path = std::filesystem::path(directory) / std::filesystem::path(pattern);
-        return Glob(path).result();
+        return Glob(path, exclusions).result();
+    }
+
+    // A "!pattern" entry of a list removes what it matches from the other patterns of the list
+    static inline bool IsExclusion(const std::string& pattern)
+    {
+        return pattern.starts_with('!');
+    }
+
+    static inline auto GetExclusions(const std::string& directory, const std::vector<std::shared_ptr<std::string>>& patterns)
+    {
+        std::vector<std::string> exclusions {};
+        for (auto& pattern : patterns) {
+            if (IsExclusion(*pattern)) {
+                exclusions.push_back(std::filesystem::path(directory) / std::filesystem::path(pattern->substr(1)));
+            }
+        }
+        return exclusions;
     }
 
     static inline auto GetExtension(const std::string& filename)
@@ -50,16 +69,18 @@ public:
 
         std::filesystem::path cur_path = dirs[begin];
 
-        for (size_t at = begin + 1; at < dirs.size(); at++) {
-            if (!std::filesystem::exists(cur_path)) {
-                std::filesystem::create_directory(cur_path);
+        const auto create_if_missing = [](const std::filesystem::path& path) {
+            if (!StatCache::the().exists(path)) {
+                std::filesystem::create_directory(path);
+                StatCache::the().record_directory(path);
             }
+        };
 
+        for (size_t at = begin + 1; at < dirs.size(); at++) {
+            create_if_missing(cur_path);
             cur_path = cur_path / dirs[at];
         }
 
-        if (!std::filesystem::exists(cur_path)) {
-            std::filesystem::create_directory(cur_path);
-        }
+        create_if_missing(cur_path);
     }
 };
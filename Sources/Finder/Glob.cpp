@@ -0,0 +1,452 @@
+#include "Glob.h"
+
+#include "../Config.h"
+#include "StatCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <thread>
+
+Glob::Glob(const std::string& pattern, const std::vector<std::string>& exclusions)
+{
+    auto key = pattern;
+    for (auto& exclusion : exclusions) {
+        key += "\n!" + exclusion;
+    }
+    if (auto cached = GlobCache::the().result(key)) {
+        m_result = std::move(*cached);
+        return;
+    }
+
+    m_base = compile(pattern, m_segments);
+    if (m_segments.empty()) {
+        return;
+    }
+
+    // a trailing "**" can't stand for directories, it's an ordinary wildcard
+    if (m_segments.back().type == Segment::Type::Recursive) {
+        m_segments.back() = compile_segment("*");
+    }
+
+    for (auto& exclusion : exclusions) {
+        std::vector<Segment> segments {};
+        if (compile(exclusion, segments) != m_base) {
+            continue;
+        }
+        // "." adds nothing to a path, entries are compared without it
+        std::erase_if(segments, [](const Segment& segment) {
+            return segment.type == Segment::Type::Literal && segment.literal == ".";
+        });
+        if (!segments.empty() && segments.back().type == Segment::Type::Recursive) {
+            segments.pop_back();
+        }
+        if (!segments.empty()) {
+            m_exclusions.push_back(std::move(segments));
+        }
+    }
+
+    // only wildcard directories fan out, anything else is a single directory read
+    bool fans_out = false;
+    for (size_t at = 0; at + 1 < m_segments.size(); at++) {
+        fans_out |= m_segments[at].type != Segment::Type::Literal;
+    }
+
+    // the calling thread walks with index 0, every helper of the pool has its own index after it
+    size_t helpers = fans_out ? Pool::the().helpers() : 0;
+    for (size_t at = 0; at <= helpers; at++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    push(*m_workers.front(), { .segment = 0, .base = m_base, .recursive = false });
+
+    if (helpers) {
+        Pool::the().join(this);
+    }
+    walk(0);
+    if (helpers) {
+        Pool::the().leave(this);
+    }
+
+    std::vector<std::string> result {};
+    for (auto& worker : m_workers) {
+        std::move(worker->result.begin(), worker->result.end(), std::back_inserter(result));
+    }
+    m_workers.clear();
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    m_result.assign(result.begin(), result.end());
+    GlobCache::the().store_result(key, m_result);
+}
+
+// "-glob-threads~<count>" is read once, when the first glob fans out
+Glob::Pool::Pool()
+{
+    auto fallback = static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 1u, MaxThreads));
+    m_helpers = static_cast<size_t>(std::max(Config::the().int_flag("glob-threads", fallback), 1)) - 1;
+    for (size_t at = 1; at <= m_helpers; at++) {
+        std::thread([this, at]() { help(at); }).detach();
+    }
+}
+
+void Glob::Pool::join(Glob* glob)
+{
+    {
+        auto _ = std::lock_guard(m_mutex);
+        m_globs.push_back(glob);
+    }
+    m_wake.notify_all();
+}
+
+// Helpers only start walking a glob while it's listed, so none is left in it once they're gone
+void Glob::Pool::leave(Glob* glob)
+{
+    {
+        auto _ = std::lock_guard(m_mutex);
+        std::erase(m_globs, glob);
+    }
+    while (glob->m_helping.load() > 0) {
+        std::this_thread::yield();
+    }
+}
+
+void Glob::Pool::help(size_t worker_index)
+{
+    for (;;) {
+        Glob* glob {};
+        {
+            auto lock = std::unique_lock(m_mutex);
+            m_wake.wait(lock, [this]() { return !m_globs.empty(); });
+            glob = m_globs[m_next++ % m_globs.size()];
+            glob->m_helping++;
+        }
+        glob->walk(worker_index);
+        glob->m_helping--;
+    }
+}
+
+// Splits the pattern into segments and returns the directory they start from
+std::string Glob::compile(const std::string& pattern, std::vector<Segment>& segments)
+{
+    std::string base {};
+    size_t at = 0;
+    if (pattern.starts_with("~") && (pattern.size() == 1 || pattern[1] == '/')) {
+        if (auto home = getenv("HOME")) {
+            base = home;
+            at = 1;
+        }
+    } else if (pattern.starts_with("/")) {
+        base = "/";
+    }
+
+    while (at < pattern.size()) {
+        auto end = pattern.find('/', at);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        if (end > at) {
+            segments.push_back(compile_segment(pattern.substr(at, end - at)));
+        }
+        at = end + 1;
+    }
+    return base;
+}
+
+Glob::Segment Glob::compile_segment(const std::string& text)
+{
+    if (text == "**") {
+        return { .type = Segment::Type::Recursive };
+    }
+
+    Segment segment { .type = Segment::Type::Literal, .matches_hidden = text.starts_with('.') };
+    for (size_t at = 0; at < text.size(); at++) {
+        Token token {};
+        if (text[at] == '\\' && at + 1 < text.size()) {
+            token.symbol = text[++at];
+        } else if (text[at] == '*') {
+            // consecutive stars match the same as a single one
+            if (!segment.tokens.empty() && segment.tokens.back().type == Token::Type::Star) {
+                continue;
+            }
+            token.type = Token::Type::Star;
+        } else if (text[at] == '?') {
+            token.type = Token::Type::Any;
+        } else if (text[at] == '[' && compile_class(text, at, token)) {
+            token.type = Token::Type::Class;
+        } else {
+            token.symbol = text[at];
+        }
+
+        if (token.type != Token::Type::Symbol) {
+            segment.type = Segment::Type::Wildcard;
+        } else {
+            segment.literal.push_back(token.symbol);
+        }
+        segment.tokens.push_back(std::move(token));
+    }
+    return segment;
+}
+
+// Parses "[abc]", "[a-z]" or a negated "[!abc]" starting at text[at], an unterminated one stays literal
+bool Glob::compile_class(const std::string& text, size_t& at, Token& token)
+{
+    size_t cur = at + 1;
+    bool negated = cur < text.size() && (text[cur] == '!' || text[cur] == '^');
+    if (negated) {
+        cur++;
+    }
+
+    std::bitset<256> symbols {};
+    bool first = true;
+    while (cur < text.size() && (text[cur] != ']' || first)) {
+        auto from = static_cast<unsigned char>(text[cur]);
+        auto to = from;
+        if (cur + 2 < text.size() && text[cur + 1] == '-' && text[cur + 2] != ']') {
+            to = static_cast<unsigned char>(text[cur + 2]);
+            cur += 2;
+        }
+        for (unsigned symbol = from; symbol <= to; symbol++) {
+            symbols.set(symbol);
+        }
+        cur++;
+        first = false;
+    }
+
+    if (cur >= text.size()) {
+        return false;
+    }
+
+    token.symbols = negated ? ~symbols : symbols;
+    at = cur;
+    return true;
+}
+
+bool Glob::match_token(const Token& token, char symbol)
+{
+    switch (token.type) {
+    case Token::Type::Symbol:
+        return token.symbol == symbol;
+    case Token::Type::Any:
+        return true;
+    case Token::Type::Class:
+        return token.symbols.test(static_cast<unsigned char>(symbol));
+    default:
+        return false;
+    }
+}
+
+bool Glob::match(const Segment& segment, std::string_view name)
+{
+    if (name.starts_with('.') && !segment.matches_hidden) {
+        return false;
+    }
+
+    // a star is backtracked to only when the tokens after it stop matching
+    auto& tokens = segment.tokens;
+    size_t token = 0;
+    size_t at = 0;
+    size_t star_token = std::string::npos;
+    size_t star_at = 0;
+    while (at < name.size()) {
+        if (token < tokens.size() && tokens[token].type == Token::Type::Star) {
+            star_token = token++;
+            star_at = at;
+        } else if (token < tokens.size() && match_token(tokens[token], name[at])) {
+            token++;
+            at++;
+        } else if (star_token != std::string::npos) {
+            token = star_token + 1;
+            at = ++star_at;
+        } else {
+            return false;
+        }
+    }
+    while (token < tokens.size() && tokens[token].type == Token::Type::Star) {
+        token++;
+    }
+    return token == tokens.size();
+}
+
+bool Glob::match_parts(const std::vector<Segment>& segments, size_t segment_index, const std::vector<std::string_view>& parts, size_t part_index)
+{
+    if (segment_index == segments.size() || part_index == parts.size()) {
+        return segment_index == segments.size() && part_index == parts.size();
+    }
+
+    auto& segment = segments[segment_index];
+    if (segment.type == Segment::Type::Recursive) {
+        // one or more directories, the segments after it still need a part to match
+        for (size_t end = part_index + 1; end < parts.size(); end++) {
+            if (match_parts(segments, segment_index + 1, parts, end)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool matches = segment.type == Segment::Type::Literal ? parts[part_index] == segment.literal : match(segment, parts[part_index]);
+    return matches && match_parts(segments, segment_index + 1, parts, part_index + 1);
+}
+
+// Entries are checked before they are descended into, so matching the path itself is enough
+bool Glob::excluded(const std::string& path) const
+{
+    if (m_exclusions.empty()) {
+        return false;
+    }
+
+    std::vector<std::string_view> parts {};
+    std::string_view rest(path);
+    rest.remove_prefix(std::min(m_base.size(), rest.size()));
+    while (!rest.empty()) {
+        auto end = std::min(rest.find('/'), rest.size());
+        auto part = rest.substr(0, end);
+        if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        rest.remove_prefix(std::min(end + 1, rest.size()));
+    }
+
+    for (auto& exclusion : m_exclusions) {
+        if (match_parts(exclusion, 0, parts, 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Glob::join(const std::string& base, const std::string& name)
+{
+    if (base.empty()) {
+        return name;
+    }
+    if (base.ends_with('/')) {
+        return base + name;
+    }
+    return base + "/" + name;
+}
+
+bool Glob::leads_to_directory(const std::string& path, unsigned char type)
+{
+    if (type == DT_DIR) {
+        return true;
+    }
+    return type == DT_LNK && StatCache::the().is_directory(path);
+}
+
+void Glob::walk(size_t worker_index)
+{
+    Task task {};
+    while (m_pending.load() > 0) {
+        if (pop(worker_index, task)) {
+            visit(task, *m_workers[worker_index]);
+            m_pending--;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Glob::visit(const Task& task, Worker& worker)
+{
+    if (!task.recursive) {
+        step(task.segment, task.base, nullptr, worker);
+        return;
+    }
+
+    // the base is one of the directories "**" stands for: the rest of the pattern is matched
+    // inside of it and its subdirectories are walked further, both from a single read
+    auto entries = GlobCache::the().list(task.base);
+    step(task.segment + 1, task.base, entries.get(), worker);
+    for (auto& entry : *entries) {
+        if (entry.type != DT_DIR) {
+            continue;
+        }
+        auto path = join(task.base, entry.name);
+        if (!excluded(path)) {
+            push(worker, { .segment = task.segment, .base = std::move(path), .recursive = true });
+        }
+    }
+}
+
+void Glob::step(size_t segment_index, const std::string& base, const std::vector<Entry>* listed, Worker& worker)
+{
+    auto& segment = m_segments[segment_index];
+    bool last = segment_index + 1 == m_segments.size();
+
+    if (segment.type == Segment::Type::Literal) {
+        auto path = join(base, segment.literal);
+        if (excluded(path)) {
+            return;
+        }
+        if (!last) {
+            step(segment_index + 1, path, nullptr, worker);
+        } else if (StatCache::the().exists(path)) {
+            worker.result.push_back(std::move(path));
+        }
+        return;
+    }
+
+    GlobCache::Listing entries {};
+    if (!listed) {
+        entries = GlobCache::the().list(base);
+        listed = entries.get();
+    }
+
+    for (auto& entry : *listed) {
+        // "**" only looks for directories to walk
+        bool relevant = segment.type == Segment::Type::Recursive ? entry.type == DT_DIR || entry.type == DT_LNK : match(segment, entry.name);
+        if (!relevant) {
+            continue;
+        }
+        auto path = join(base, entry.name);
+        if (excluded(path)) {
+            continue;
+        }
+
+        // symlinked directories are entered, but "**" doesn't walk them further
+        if (segment.type == Segment::Type::Recursive) {
+            if (entry.type == DT_DIR) {
+                push(worker, { .segment = segment_index, .base = std::move(path), .recursive = true });
+            } else if (leads_to_directory(path, entry.type)) {
+                push(worker, { .segment = segment_index + 1, .base = std::move(path), .recursive = false });
+            }
+        } else if (last) {
+            worker.result.push_back(std::move(path));
+        } else if (leads_to_directory(path, entry.type)) {
+            push(worker, { .segment = segment_index + 1, .base = std::move(path), .recursive = false });
+        }
+    }
+}
+
+void Glob::push(Worker& worker, Task task)
+{
+    m_pending++;
+    auto _ = ScopedLocker(worker.lock);
+    worker.tasks.push_back(std::move(task));
+}
+
+// Workers take their newest task, deepest in the tree, and steal the oldest one of the others
+bool Glob::pop(size_t worker_index, Task& task)
+{
+    {
+        auto& worker = *m_workers[worker_index];
+        auto _ = ScopedLocker(worker.lock);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < m_workers.size(); offset++) {
+        auto& victim = *m_workers[(worker_index + offset) % m_workers.size()];
+        auto _ = ScopedLocker(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
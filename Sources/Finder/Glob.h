@@ -1,94 +1,132 @@
+/*
+ * Glob compiles a pattern into path segments once and walks the tree in a single pass.
+ * Literal segments are joined without reading their parent, wildcard segments are matched
+ * in-process against entries read in getdents64 batches, and directories that can't lead
+ * to a match are never opened. A "**" segment stands for one or more directories.
+ *
+ * Exclusion patterns are checked against every entry before it's descended into or returned,
+ * an excluded directory is never opened. A folder pattern ending in two stars excludes the folder itself.
+ *
+ * Patterns with wildcard directories are walked by the calling thread together with the helpers of
+ * a process-wide pool, which is started once and shared by all the globs. They steal directories
+ * from each other, the result is sorted so it doesn't depend on the scheduling.
+ */
+
 #pragma once
 
-#include <glob.h>
-#include <cstring>
+#include "../Utils/Lock.h"
+#include "GlobCache.h"
+
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
 
 class Glob {
-    struct Fragment {
-        std::filesystem::path path;
-        bool recursive;
+    struct Token {
+        enum class Type {
+            Symbol,
+            Any,
+            Star,
+            Class,
+        };
+
+        Type type {};
+        char symbol {};
+        std::bitset<256> symbols {};
     };
 
-public:
-    explicit Glob(const std::string& pattern)
-    {
-        split_into_fragments(pattern);
-        search();
-    }
+    struct Segment {
+        enum class Type {
+            Literal,
+            Wildcard,
+            Recursive,
+        };
 
-    std::vector<std::filesystem::path>&& result() { return std::move(m_result); }
+        Type type {};
+        std::string literal {};
+        std::vector<Token> tokens {};
+        // like glob(), wildcards only match hidden entries when the segment itself starts with a dot
+        bool matches_hidden {};
+    };
 
-private:
-    inline void split_into_fragments(const std::string& pattern)
-    {
-        for (int at = 0; at < pattern.size(); at++) {
-            if (at + 2 < pattern.size()) {
-                if (pattern[at] == '*' && pattern[at + 1] == '/') {
-                    m_fragments.push_back({ m_ending, false });
-                    m_ending.clear();
-                    at += 1;
-                    continue;
-                }
-            }
-            if (at + 3 < pattern.size()) {
-                if (pattern[at] == '*' && pattern[at + 1] == '*' && pattern[at + 2] == '/') {
-                    m_fragments.push_back({ m_ending, true });
-                    m_ending.clear();
-                    at += 2;
-                    continue;
-                }
-            }
-            m_ending.push_back(pattern[at]);
-        }
-    }
-
-    inline void search(int fragment = 0, const std::filesystem::path& cur_path = "")
-    {
-        if (fragment == m_fragments.size()) {
-            auto found = glob(cur_path / m_ending);
-            std::copy(found.begin(), found.end(), std::back_inserter(m_result));
-            return;
-        }
+    using Entry = GlobCache::Entry;
 
-        std::filesystem::path search_in = cur_path.empty() ? m_fragments[fragment].path : cur_path / m_fragments[fragment].path;
-        search_in = search_in.empty() ? "." : search_in;
+    // A directory to match against the segment, or one below the "**" segment when recursive
+    struct Task {
+        size_t segment;
+        std::string base;
+        bool recursive;
+    };
 
-        if (!std::filesystem::exists(search_in)) {
-            return;
-        }
+    struct Worker {
+        SpinLock lock {};
+        std::deque<Task> tasks {};
+        std::vector<std::string> result {};
+    };
 
-        if (m_fragments[fragment].recursive) {
-            for (auto& file : std::filesystem::recursive_directory_iterator(search_in)) {
-                search(fragment + 1, file.path());
-            }
-        } else {
-            for (auto& file : std::filesystem::directory_iterator(search_in)) {
-                search(fragment + 1, file.path());
-            }
+    // Helper threads waiting for globs that fan out, a helper walks one glob at a time
+    class Pool {
+    public:
+        static Pool& the()
+        {
+            // never destroyed, the helpers are still waiting when the process exits
+            static auto instance = new Pool();
+            return *instance;
         }
-    }
 
-    static inline std::vector<std::filesystem::path> glob(const std::string& pattern) {
-        glob_t glob_result;
-        memset(&glob_result, 0, sizeof(glob_result));
+        size_t helpers() const { return m_helpers; }
+        void join(Glob* glob);
+        void leave(Glob* glob);
 
-        int res = ::glob(pattern.c_str(), GLOB_TILDE | GLOB_NOSORT, nullptr, &glob_result);
-        std::vector<std::filesystem::path> filenames {};
+    private:
+        Pool();
+        void help(size_t worker_index);
 
-        if (res >= 0) {
-            for (size_t i = 0; i < glob_result.gl_pathc; i++) {
-                filenames.emplace_back(glob_result.gl_pathv[i]);
-            }
-        }
+        size_t m_helpers {};
+        std::mutex m_mutex {};
+        std::condition_variable m_wake {};
+        std::vector<Glob*> m_globs {};
+        size_t m_next {};
+    };
+
+    static constexpr unsigned MaxThreads = 8;
+
+public:
+    explicit Glob(const std::string& pattern, const std::vector<std::string>& exclusions = {});
+
+    std::vector<std::filesystem::path>&& result() { return std::move(m_result); }
+
+private:
+    static std::string compile(const std::string& pattern, std::vector<Segment>& segments);
+    static Segment compile_segment(const std::string& text);
+    static bool compile_class(const std::string& text, size_t& at, Token& token);
+    static bool match_token(const Token& token, char symbol);
+    static bool match(const Segment& segment, std::string_view name);
+    static bool match_parts(const std::vector<Segment>& segments, size_t segment_index, const std::vector<std::string_view>& parts, size_t part_index);
+    bool excluded(const std::string& path) const;
 
-        globfree(&glob_result);
+    static std::string join(const std::string& base, const std::string& name);
+    static bool leads_to_directory(const std::string& path, unsigned char type);
 
-        return filenames;
-    }
+    void walk(size_t worker_index);
+    void visit(const Task& task, Worker& worker);
+    void step(size_t segment_index, const std::string& base, const std::vector<Entry>* listed, Worker& worker);
+    void push(Worker& worker, Task task);
+    bool pop(size_t worker_index, Task& task);
 
 private:
-    std::vector<Fragment> m_fragments {};
-    std::string m_ending {};
+    std::string m_base {};
+    std::vector<Segment> m_segments {};
+    std::vector<std::vector<Segment>> m_exclusions {};
+    std::vector<std::unique_ptr<Worker>> m_workers {};
+    std::atomic<size_t> m_pending {};
+    std::atomic<size_t> m_helping {};
     std::vector<std::filesystem::path> m_result {};
-};
\ No newline at end of file
+};
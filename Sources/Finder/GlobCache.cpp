@@ -0,0 +1,244 @@
+#include "GlobCache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static constexpr size_t DirectoryBufferSize = 32 * 1024;
+
+// A directory changed within the last second may change again without its mtime moving
+static constexpr time_t RacyInterval = 1;
+
+static bool SameTime(const timespec& a, const timespec& b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Names are stored one per line
+static bool Storable(const std::string& path, const std::vector<GlobCache::Entry>& entries)
+{
+    if (path.find('\n') != std::string::npos) {
+        return false;
+    }
+    for (auto& entry : entries) {
+        if (entry.name.find('\n') != std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+GlobCache::Listing GlobCache::list(const std::string& directory)
+{
+    static const auto empty = std::make_shared<const std::vector<Entry>>();
+    auto key = directory.empty() ? std::string(".") : directory;
+
+    {
+        auto _ = ScopedLocker(m_lock);
+        if (!m_loaded) {
+            load();
+        }
+        auto cached = m_directories.find(key);
+        if (cached != m_directories.end() && cached->second.validated == m_generation) {
+            cached->second.used = true;
+            return cached->second.entries;
+        }
+    }
+
+    struct stat directory_stat {};
+    if (stat(key.c_str(), &directory_stat) < 0 || !S_ISDIR(directory_stat.st_mode)) {
+        return empty;
+    }
+
+    {
+        auto _ = ScopedLocker(m_lock);
+        auto cached = m_directories.find(key);
+        if (cached != m_directories.end() && SameTime(cached->second.mtime, directory_stat.st_mtim)) {
+            cached->second.validated = m_generation;
+            cached->second.used = true;
+            return cached->second.entries;
+        }
+    }
+
+    int fd = open(key.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return empty;
+    }
+
+    // the mtime is taken before reading, a change made meanwhile makes the next build read it again
+    fstat(fd, &directory_stat);
+    auto entries = std::make_shared<const std::vector<Entry>>(read(fd));
+    close(fd);
+
+    timespec now {};
+    clock_gettime(CLOCK_REALTIME, &now);
+    bool racy = now.tv_sec - directory_stat.st_mtim.tv_sec <= RacyInterval;
+
+    auto _ = ScopedLocker(m_lock);
+    auto& cached = m_directories[key];
+    cached.mtime = racy ? timespec {} : directory_stat.st_mtim;
+    cached.entries = entries;
+    cached.validated = m_generation;
+    cached.used = true;
+    m_dirty = true;
+    return entries;
+}
+
+std::vector<GlobCache::Entry> GlobCache::read(int fd)
+{
+    struct linux_dirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    std::vector<Entry> entries {};
+    alignas(linux_dirent64) char buffer[DirectoryBufferSize];
+    while (true) {
+        auto bytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < bytes;) {
+            auto entry = reinterpret_cast<linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            // some filesystems don't fill d_type
+            auto type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat entry_stat {};
+                if (fstatat(fd, name.c_str(), &entry_stat, AT_SYMLINK_NOFOLLOW) == 0) {
+                    type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISLNK(entry_stat.st_mode) ? DT_LNK : DT_REG;
+                }
+            }
+            entries.push_back({ std::move(name), type });
+        }
+    }
+    return entries;
+}
+
+std::optional<std::vector<std::filesystem::path>> GlobCache::result(const std::string& pattern)
+{
+    auto _ = ScopedLocker(m_lock);
+    auto cached = m_results.find(pattern);
+    if (cached == m_results.end()) {
+        return {};
+    }
+    return cached->second;
+}
+
+void GlobCache::store_result(const std::string& pattern, const std::vector<std::filesystem::path>& result)
+{
+    auto _ = ScopedLocker(m_lock);
+    m_results[pattern] = result;
+}
+
+void GlobCache::revalidate()
+{
+    auto _ = ScopedLocker(m_lock);
+    m_generation++;
+    m_results.clear();
+}
+
+// "D <seconds> <nanoseconds> <directory>" is followed by a "<type> <name>" line for each of its entries
+template <class Number>
+static bool ParseNumber(std::string_view text, Number& number)
+{
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+    return error == std::errc() && end == text.data() + text.size() && !text.empty();
+}
+
+// A damaged line drops the listing it belongs to, the directory is read again as if it wasn't cached
+void GlobCache::load()
+{
+    m_loaded = true;
+
+    std::ifstream stream(CacheFile);
+    std::string line;
+    std::string path {};
+    std::vector<Entry>* entries {};
+    while (std::getline(stream, line)) {
+        std::string_view view = line;
+        if (view.starts_with("D ")) {
+            entries = nullptr;
+            auto seconds_end = view.find(' ', 2);
+            auto nanoseconds_end = seconds_end == std::string::npos ? std::string::npos : view.find(' ', seconds_end + 1);
+            timespec mtime {};
+            if (nanoseconds_end == std::string::npos || nanoseconds_end + 1 == view.size()
+                || !ParseNumber(view.substr(2, seconds_end - 2), mtime.tv_sec)
+                || !ParseNumber(view.substr(seconds_end + 1, nanoseconds_end - seconds_end - 1), mtime.tv_nsec)) {
+                continue;
+            }
+
+            auto listing = std::make_shared<std::vector<Entry>>();
+            entries = listing.get();
+            path = line.substr(nanoseconds_end + 1);
+            m_directories[path] = Directory {
+                .mtime = mtime,
+                .entries = std::move(listing),
+            };
+        } else if (entries) {
+            if (line.size() > 2 && line[1] == ' ' && line[0] >= '0' && line[0] <= '0' + DT_WHT) {
+                entries->push_back({ line.substr(2), static_cast<unsigned char>(line[0] - '0') });
+            } else {
+                m_directories.erase(path);
+                entries = nullptr;
+            }
+        }
+    }
+}
+
+std::vector<std::string> GlobCache::used_directories()
+{
+    std::vector<std::string> directories {};
+    {
+        auto _ = ScopedLocker(m_lock);
+        for (auto& [path, directory] : m_directories) {
+            if (directory.used) {
+                directories.push_back(path);
+            }
+        }
+    }
+    std::sort(directories.begin(), directories.end());
+    return directories;
+}
+
+void GlobCache::save()
+{
+    auto _ = ScopedLocker(m_lock);
+    if (!m_dirty) {
+        return;
+    }
+    m_dirty = false;
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(CacheFile).parent_path(), error);
+
+    auto temporary = std::string(CacheFile) + ".tmp";
+    {
+        std::ofstream stream(temporary, std::ofstream::out | std::ofstream::trunc);
+        for (auto& [path, directory] : m_directories) {
+            if (!directory.used || !directory.mtime.tv_sec || !Storable(path, *directory.entries)) {
+                continue;
+            }
+            stream << "D " << directory.mtime.tv_sec << " " << directory.mtime.tv_nsec << " " << path << "\n";
+            for (auto& entry : *directory.entries) {
+                stream << static_cast<char>('0' + entry.type) << " " << entry.name << "\n";
+            }
+        }
+    }
+    rename(temporary.c_str(), CacheFile);
+}
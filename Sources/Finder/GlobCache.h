@@ -0,0 +1,74 @@
+/*
+ * GlobCache keeps the listings of the directories walked by Glob together with their mtimes
+ * in MacaBuild/globs.macainfo. A listing is reused as long as the directory's mtime is unchanged,
+ * so an unchanged tree costs one stat per directory instead of reading it. Within a build,
+ * listings and the results of whole patterns are reused without looking at the disk at all.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GlobCache {
+public:
+    struct Entry {
+        std::string name;
+        unsigned char type;
+    };
+
+    using Listing = std::shared_ptr<const std::vector<Entry>>;
+
+    static constexpr auto CacheFile = "MacaBuild/globs.macainfo";
+
+public:
+    static GlobCache& the()
+    {
+        static auto instance = GlobCache();
+        return instance;
+    }
+
+    // Entries of the directory without "." and "..", empty if it can't be read
+    Listing list(const std::string& directory);
+
+    std::optional<std::vector<std::filesystem::path>> result(const std::string& pattern);
+    void store_result(const std::string& pattern, const std::vector<std::filesystem::path>& result);
+
+    // Starts a new build: every directory has to be checked against the disk again
+    void revalidate();
+
+    // Writes the listings used since the cache was loaded, if any of them was read from the disk
+    void save();
+
+    // The directories listed since the cache was loaded, sorted
+    std::vector<std::string> used_directories();
+
+private:
+    struct Directory {
+        timespec mtime {};
+        Listing entries {};
+        size_t validated {};
+        bool used {};
+    };
+
+private:
+    GlobCache() = default;
+
+    void load();
+    static std::vector<Entry> read(int fd);
+
+private:
+    SpinLock m_lock {};
+    bool m_loaded {};
+    bool m_dirty {};
+    size_t m_generation { 1 };
+    std::unordered_map<std::string, Directory> m_directories {};
+    std::unordered_map<std::string, std::vector<std::filesystem::path>> m_results {};
+};
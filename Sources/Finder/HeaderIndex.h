@@ -0,0 +1,129 @@
+/*
+ * HeaderIndex lists every HeaderFolders entry once and maps relative header names
+ * to the first folder containing them, which is the one a global include resolves to.
+ */
+
+#pragma once
+
+#include "StatCache.h"
+
+#include <dirent.h>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+class HeaderIndex {
+public:
+    HeaderIndex() = default;
+
+    void build(const std::filesystem::path& directory, const std::vector<std::shared_ptr<std::string>>& header_folders)
+    {
+        clear();
+        for (auto& header_folder : header_folders) {
+            m_folders.push_back(directory / *header_folder);
+            m_visited.clear();
+            list(m_folders.back().string(), "", m_folders.size() - 1);
+        }
+        m_built = true;
+    }
+
+    inline void clear()
+    {
+        m_folders.clear();
+        m_headers.clear();
+        m_built = false;
+    }
+
+    inline bool built() const { return m_built; }
+
+    std::optional<std::filesystem::path> find(const std::string& include)
+    {
+        auto normal = std::filesystem::path(include).lexically_normal();
+
+        // the index only knows what's inside of the folders
+        if (normal.empty() || *normal.begin() == "..") {
+            for (auto& folder : m_folders) {
+                auto path = folder / include;
+                if (StatCache::the().exists(path)) {
+                    return path;
+                }
+            }
+            return {};
+        }
+
+        auto header = m_headers.find(normal.string());
+        if (header == m_headers.end()) {
+            return {};
+        }
+        return m_folders[header->second] / include;
+    }
+
+    // Number of folders searched for a global include, all of them if it isn't found
+    size_t probes(const std::string& include)
+    {
+        auto normal = std::filesystem::path(include).lexically_normal();
+        if (normal.empty() || *normal.begin() == "..") {
+            for (size_t folder = 0; folder < m_folders.size(); folder++) {
+                if (StatCache::the().exists(m_folders[folder] / include)) {
+                    return folder + 1;
+                }
+            }
+            return m_folders.size();
+        }
+
+        auto header = m_headers.find(normal.string());
+        return header == m_headers.end() ? m_folders.size() : header->second + 1;
+    }
+
+    inline const std::vector<std::filesystem::path>& folders() const { return m_folders; }
+
+private:
+    void list(const std::string& folder_path, const std::string& relative_path, size_t folder)
+    {
+        auto directory = opendir(folder_path.c_str());
+        if (!directory) {
+            return;
+        }
+
+        // symlinked folders may form a loop
+        struct stat directory_stat {};
+        if (fstat(dirfd(directory), &directory_stat) == 0 && !m_visited.insert({ directory_stat.st_dev, directory_stat.st_ino }).second) {
+            closedir(directory);
+            return;
+        }
+
+        while (auto entry = readdir(directory)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            auto entry_path = folder_path + "/" + name;
+            auto relative_entry_path = relative_path.empty() ? name : relative_path + "/" + name;
+
+            bool is_directory = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+                is_directory = StatCache::the().is_directory(entry_path);
+            }
+
+            if (is_directory) {
+                list(entry_path, relative_entry_path, folder);
+            } else {
+                m_headers.emplace(std::move(relative_entry_path), folder);
+            }
+        }
+
+        closedir(directory);
+    }
+
+private:
+    bool m_built {};
+    std::vector<std::filesystem::path> m_folders {};
+    std::unordered_map<std::string, size_t> m_headers {};
+    std::set<std::pair<dev_t, ino_t>> m_visited {};
+};
@@ -0,0 +1,165 @@
+/*
+ * PathTable canonicalizes every path once and hands out dense ids for them, every spelling
+ * of a path gets the same id. Per-file state is kept in PathArrays indexed by these ids
+ * instead of maps keyed on path strings.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PathTable {
+public:
+    using Id = uint32_t;
+
+public:
+    static PathTable& the()
+    {
+        static auto instance = PathTable();
+        return instance;
+    }
+
+    // The absolute, lexically normal path is the canonical one
+    Id id(const std::filesystem::path& path)
+    {
+        {
+            auto _ = ScopedLocker(m_lock);
+            auto known = m_spellings.find(path.native());
+            if (known != m_spellings.end()) {
+                return known->second;
+            }
+        }
+
+        auto canonical = (path.is_absolute() ? path : m_cwd / path).lexically_normal();
+        auto _ = ScopedLocker(m_lock);
+        auto id = insert(canonical.native());
+        m_spellings.emplace(path.native(), id);
+        return id;
+    }
+
+    // Like id(), with symlinks resolved, for files that mustn't be processed twice
+    Id resolved_id(const std::filesystem::path& path)
+    {
+        {
+            auto _ = ScopedLocker(m_lock);
+            auto known = m_resolved_spellings.find(path.native());
+            if (known != m_resolved_spellings.end()) {
+                return known->second;
+            }
+        }
+
+        char resolved[PATH_MAX];
+        auto id = realpath(path.c_str(), resolved) ? this->id(resolved) : this->id(path);
+        auto _ = ScopedLocker(m_lock);
+        m_resolved_spellings.emplace(path.native(), id);
+        return id;
+    }
+
+    const std::string& path(Id id)
+    {
+        auto _ = ScopedLocker(m_lock);
+        return m_paths[id];
+    }
+
+    // Lexically relative to the directory, without touching the disk
+    std::filesystem::path relative(Id id, const std::filesystem::path& directory)
+    {
+        auto base = (directory.is_absolute() ? directory : m_cwd / directory).lexically_normal();
+        return std::filesystem::path(path(id)).lexically_proximate(base);
+    }
+
+private:
+    PathTable()
+        : m_cwd(std::filesystem::current_path())
+    {
+    }
+
+    Id insert(const std::string& canonical)
+    {
+        auto known = m_ids.find(canonical);
+        if (known != m_ids.end()) {
+            return known->second;
+        }
+        auto id = static_cast<Id>(m_paths.size());
+        m_paths.push_back(canonical);
+        m_ids.emplace(canonical, id);
+        return id;
+    }
+
+private:
+    SpinLock m_lock {};
+    std::filesystem::path m_cwd {};
+    std::deque<std::string> m_paths {};
+    std::unordered_map<std::string, Id> m_ids {};
+    std::unordered_map<std::string, Id> m_spellings {};
+    std::unordered_map<std::string, Id> m_resolved_spellings {};
+};
+
+// A flat array indexed by path ids. It's allocated in pages, so a context touching a few of the paths stays small.
+template <typename T>
+class PathArray {
+    static constexpr size_t PageSize = 1024;
+
+public:
+    T& operator[](PathTable::Id id)
+    {
+        auto page_index = id / PageSize;
+        if (page_index >= m_pages.size()) {
+            m_pages.resize(page_index + 1);
+        }
+        auto& page = m_pages[page_index];
+        if (!page) {
+            page = std::make_unique<T[]>(PageSize);
+        }
+        return page[id % PageSize];
+    }
+
+    T get(PathTable::Id id) const
+    {
+        auto page_index = id / PageSize;
+        if (page_index >= m_pages.size() || !m_pages[page_index]) {
+            return T {};
+        }
+        return m_pages[page_index][id % PageSize];
+    }
+
+    // Resets every value, the pages are kept for the next build
+    void clear()
+    {
+        for (auto& page : m_pages) {
+            if (page) {
+                std::fill(page.get(), page.get() + PageSize, T {});
+            }
+        }
+    }
+
+    // Calls back with every id holding a value other than the default one
+    template <typename Callback>
+    void for_each(Callback callback) const
+    {
+        for (size_t page_index = 0; page_index < m_pages.size(); page_index++) {
+            if (!m_pages[page_index]) {
+                continue;
+            }
+            for (size_t at = 0; at < PageSize; at++) {
+                if (m_pages[page_index][at] != T {}) {
+                    callback(static_cast<PathTable::Id>(page_index * PageSize + at), m_pages[page_index][at]);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<T[]>> m_pages {};
+};
@@ -0,0 +1,76 @@
+/*
+ * StatCache remembers the result of every stat() made during a build,
+ * so that no path is statted more than once per build.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+class StatCache {
+public:
+    struct Entry {
+        bool exists {};
+        bool directory {};
+        int mtime {};
+    };
+
+public:
+    static StatCache& the()
+    {
+        static auto instance = StatCache();
+        return instance;
+    }
+
+    Entry lookup(const std::string& path)
+    {
+        {
+            auto _ = ScopedLocker(m_lock);
+            auto cached = m_entries.find(path);
+            if (cached != m_entries.end()) {
+                return cached->second;
+            }
+        }
+
+        Entry entry {};
+        struct stat file_stat {};
+        if (stat(path.c_str(), &file_stat) == 0) {
+            entry.exists = true;
+            entry.directory = S_ISDIR(file_stat.st_mode);
+            entry.mtime = static_cast<int>(file_stat.st_mtime);
+        }
+
+        auto _ = ScopedLocker(m_lock);
+        m_entries[path] = entry;
+        return entry;
+    }
+
+    inline bool exists(const std::string& path) { return lookup(path).exists; }
+    inline bool is_directory(const std::string& path) { return lookup(path).directory; }
+    inline int mtime(const std::string& path) { return lookup(path).mtime; }
+
+    // For paths created by Macabuilder itself
+    inline void record_directory(const std::string& path)
+    {
+        auto _ = ScopedLocker(m_lock);
+        m_entries[path] = Entry { .exists = true, .directory = true };
+    }
+
+    // Results are only valid for a single build
+    inline void clear()
+    {
+        auto _ = ScopedLocker(m_lock);
+        m_entries.clear();
+    }
+
+private:
+    StatCache() = default;
+
+private:
+    SpinLock m_lock {};
+    std::unordered_map<std::string, Entry> m_entries {};
+};
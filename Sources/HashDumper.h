@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Utils/Hash.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class HashDumper {
+public:
+    // The hashes are written next to the file and renamed over it, an interrupted dump leaves the old one whole
+    explicit HashDumper(const std::filesystem::path& path)
+        : m_path(path)
+        , m_temporary_path(path.string() + ".tmp")
+    {
+        m_stream.open(m_temporary_path, std::ofstream::out | std::ofstream::trunc);
+    }
+
+    ~HashDumper()
+    {
+        if (!m_stream.is_open()) {
+            return;
+        }
+        m_stream.close();
+        std::error_code error {};
+        if (m_stream.fail()) {
+            std::filesystem::remove(m_temporary_path, error);
+            return;
+        }
+        std::filesystem::rename(m_temporary_path, m_path, error);
+    }
+
+    void append(const std::string& path, uint64_t hash)
+    {
+        m_stream << path << " " << Hash::ToHex(hash) << "\n";
+    }
+
+private:
+    std::filesystem::path m_path {};
+    std::filesystem::path m_temporary_path {};
+    std::ofstream m_stream {};
+};
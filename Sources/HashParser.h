@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Utils/Hash.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class HashParser {
+public:
+    explicit HashParser(const std::filesystem::path& path)
+    {
+        m_stream.open(path, std::ifstream::in);
+    }
+
+    ~HashParser()
+    {
+        if (m_stream.is_open()) {
+            m_stream.close();
+        }
+    }
+
+    void run(const std::function<void(const std::string& path, uint64_t hash)>& callback)
+    {
+        std::string cur_line;
+        while (getline(m_stream, cur_line)) {
+            size_t pos = cur_line.rfind(' ');
+            if (pos == std::string::npos || pos == 0) {
+                continue;
+            }
+            // a damaged line only costs that object's hash, the link is redone
+            auto cur_hash = Hash::FromHex(std::string_view(cur_line).substr(pos + 1));
+            if (!cur_hash) {
+                continue;
+            }
+            callback(cur_line.substr(0, pos), *cur_hash);
+        }
+    }
+
+private:
+    std::ifstream m_stream {};
+};
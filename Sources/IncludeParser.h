@@ -21,39 +21,45 @@ public:
         }
     }
 
+    // Every #include directive of the file. Conditions and comments aren't evaluated, so headers the
+    // compiler skips can be reported too: one too many costs a rebuild, one too few a stale object.
     void run(const std::function<void(const std::string& include, bool global)>& callback)
     {
         std::string cur_line;
         while (getline(m_stream, cur_line)) {
-            size_t i = 0;
-            while (i < cur_line.size() && cur_line[i] == ' ') {
-                i++;
-            }
-            cur_line = cur_line.substr(i, cur_line.size() - i);
-
-            if (cur_line.empty()) {
+            size_t i = SkipBlanks(cur_line, 0);
+            if (i == cur_line.size() || cur_line[i] != '#') {
                 continue;
             }
 
-            if (cur_line.starts_with("#pragma")) {
+            i = SkipBlanks(cur_line, i + 1);
+            if (cur_line.compare(i, 7, "include") != 0) {
                 continue;
             }
 
-            if (!cur_line.starts_with("#include ")) {
-                return;
+            i = SkipBlanks(cur_line, i + 7);
+            if (i == cur_line.size() || (cur_line[i] != '"' && cur_line[i] != '<')) {
+                continue;
             }
 
-            bool global = true;
-            if (cur_line[9] == '\"') {
-                global = false;
+            bool global = cur_line[i] == '<';
+            auto end = cur_line.find(global ? '>' : '"', i + 1);
+            if (end == std::string::npos || end == i + 1) {
+                continue;
             }
 
-            cur_line = cur_line.substr(10, cur_line.size() - 10 - 1);
-
-            callback(cur_line, global);
+            callback(cur_line.substr(i + 1, end - i - 1), global);
         }
     }
 
 private:
+    static size_t SkipBlanks(const std::string& line, size_t at)
+    {
+        while (at < line.size() && (line[at] == ' ' || line[at] == '\t')) {
+            at++;
+        }
+        return at;
+    }
+
     std::ifstream m_stream {};
 };
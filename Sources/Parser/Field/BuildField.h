@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -16,6 +17,8 @@ public:
     struct ExtensionOption {
         std::shared_ptr<std::string> compiler;
         std::vector<std::shared_ptr<std::string>> flags {};
+        // Flags that make the compiler write an object, "-c" (nothing for nasm) unless the extension lists its own
+        std::optional<std::vector<std::shared_ptr<std::string>>> object_flags {};
     };
 
 public:
@@ -33,6 +36,8 @@ public:
         return true;
     }
 
+    inline void set_type(Type type) { m_type = type; }
+
     inline void add_dependency(const std::shared_ptr<std::string>& dependency)
     {
         m_depends.push_back(dependency);
@@ -62,6 +67,11 @@ public:
         m_extensions[*extension].flags.push_back(flag);
     }
 
+    inline void set_object_flags_to_extension(const std::shared_ptr<std::string>& extension, std::vector<std::shared_ptr<std::string>> flags)
+    {
+        m_extensions[*extension].object_flags = std::move(flags);
+    }
+
     void set_linker(const std::shared_ptr<std::string>& linker) { m_linker = linker; }
     void set_archiver(const std::shared_ptr<std::string>& archiver) { m_archiver = archiver; }
     void add_linker_flag(const std::shared_ptr<std::string>& flag) { m_linker_flags.push_back(flag); }
@@ -1,18 +1,37 @@
 #include "Lexer.h"
 
-#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-Lexer::Lexer(const std::string& path)
+// Most tokens are a few characters long, reserving for them avoids regrowing on large files
+static constexpr size_t BytesPerToken = 8;
+
+Lexer::Lexer(const std::string& path, Arena& arena)
     : m_path(path)
+    , m_arena(&arena)
 {
-    m_stream.open(path, std::ifstream::in);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        auto data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = static_cast<const char*>(data);
+            m_size = file_stat.st_size;
+        }
+    }
+    close(fd);
 }
 
 Lexer::~Lexer()
 {
-    if (m_stream.is_open()) {
-        m_stream.close();
-    }
+    unmap();
 }
 
 Lexer::Lexer(Lexer&& lexer) noexcept
@@ -22,110 +41,119 @@ Lexer::Lexer(Lexer&& lexer) noexcept
 
 Lexer& Lexer::operator=(Lexer&& lexer) noexcept
 {
+    unmap();
     m_path = std::move(lexer.m_path);
-    m_stream = std::move(lexer.m_stream);
+    m_arena = lexer.m_arena;
+    m_data = std::exchange(lexer.m_data, nullptr);
+    m_size = std::exchange(lexer.m_size, 0);
     m_tokens = std::move(lexer.m_tokens);
-    m_line_idx = lexer.m_line_idx;
-    m_cur_line = std::move(lexer.m_cur_line);
+    m_token_line = lexer.m_token_line;
+    m_variables = std::move(lexer.m_variables);
     return *this;
 }
 
+void Lexer::unmap()
+{
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
 void Lexer::run()
 {
-    while (next_string()) {
-        int nesting = calc_nesting_for_cur_line();
-        std::string cur_word {};
-
-        while (char c = eat()) {
-            if (c == '\\') {
-                cur_word.push_back(eat());
-                continue;
-            }
+    m_tokens.reserve(m_size / BytesPerToken);
 
-            auto token = Token::TokenFromChar(c, nesting, m_token_line);
+    size_t at = 0;
+    while (at < m_size) {
+        auto end = static_cast<const char*>(memchr(m_data + at, '\n', m_size - at));
+        size_t line_end = end ? end - m_data : m_size;
 
-            if (token.type() == Token::Type::Default) {
-                cur_word.push_back(c);
-                continue;
-            }
+        m_token_line++;
+        lex_line({ m_data + at, line_end - at });
+        at = line_end + 1;
+    }
+}
 
-            if (token.type() == Token::Type::VariableBegin) {
-                if (!cur_word.empty()) {
-                    m_tokens.emplace_back(cur_word, Token::Type::Default, nesting, m_token_line);
-                    cur_word.clear();
-                }
-                while (char var_c = eat()) {
-                    if (Token::token_type(var_c) == Token::Type::VariableEnd) {
-                        break;
-                    }
-                    cur_word.push_back(var_c);
-                }
-                token.m_content = std::make_shared<std::string>(cur_word);
-                token.m_type = Token::Type::Variable;
-                m_tokens.push_back(token);
-                m_variables.push_back(m_tokens.size() - 1);
-                eat_spaces();
-                cur_word.clear();
-                continue;
-            }
+void Lexer::lex_line(std::string_view line)
+{
+    size_t at = 0;
+    int nesting = calc_nesting(line, at);
 
-            if (!cur_word.empty()) {
-                m_tokens.emplace_back(cur_word, Token::Type::Default, nesting, m_token_line);
-                cur_word.clear();
-            }
-            m_tokens.push_back(token);
-            eat_spaces();
+    while (at < line.size()) {
+        auto type = Token::token_type(line[at]);
+
+        if (type == Token::Type::Default) {
+            at = lex_word(line, at, nesting);
+            continue;
         }
 
-        if (!cur_word.empty()) {
-            m_tokens.emplace_back(cur_word, Token::Type::Default, nesting, m_token_line);
+        if (type == Token::Type::VariableBegin) {
+            auto end = line.find('}', at + 1);
+            auto name = line.substr(at + 1, end == std::string_view::npos ? std::string_view::npos : end - at - 1);
+            m_tokens.emplace_back(name, Token::Type::Variable, nesting, m_token_line);
+            m_variables.push_back(m_tokens.size() - 1);
+            at = skip_spaces(line, end == std::string_view::npos ? line.size() : end + 1);
+            continue;
         }
+
+        m_tokens.emplace_back(type, nesting, m_token_line);
+        at = skip_spaces(line, at + 1);
     }
 }
-int Lexer::calc_nesting_for_cur_line()
+
+// A word runs up to the next special character, spaces included
+size_t Lexer::lex_word(std::string_view line, size_t at, int nesting)
 {
-    int nesting = 0;
-    while (char cur = lookup()) {
-        if (cur == ' ') {
-            eat();
-            if (chars_remain() < 3) {
-                return nesting;
-            }
-            for (size_t i = 0; i < 3; i++) {
-                if (lookup() != ' ') {
-                    return nesting;
-                }
-                eat();
-            }
-            nesting++;
-            continue;
-        }
+    size_t begin = at;
+    while (at < line.size() && Token::token_type(line[at]) == Token::Type::Default && line[at] != '\\') {
+        at++;
+    }
+    if (at == line.size() || line[at] != '\\') {
+        m_tokens.emplace_back(line.substr(begin, at - begin), Token::Type::Default, nesting, m_token_line);
+        return at;
+    }
 
-        if (cur == '\n') {
-            nesting++;
-            eat();
+    // an escaped character belongs to the word whatever it is, so the word has to be copied
+    std::string word(line.substr(begin, at - begin));
+    while (at < line.size() && Token::token_type(line[at]) == Token::Type::Default) {
+        if (line[at] == '\\') {
+            if (++at < line.size()) {
+                word.push_back(line[at++]);
+            }
             continue;
         }
-
-        return nesting;
+        word.push_back(line[at++]);
     }
-
-    return nesting;
+    m_tokens.emplace_back(m_arena->store(word), Token::Type::Default, nesting, m_token_line);
+    return at;
 }
 
-bool Lexer::next_string()
+// Every four leading spaces are one level of nesting
+int Lexer::calc_nesting(std::string_view line, size_t& at)
 {
-    m_line_idx = 0;
-    m_token_line++;
-    return bool(getline(m_stream, m_cur_line));
+    int nesting = 0;
+    while (at < line.size() && line[at] == ' ') {
+        at++;
+        if (line.size() - at < 3) {
+            return nesting;
+        }
+        for (size_t i = 0; i < 3; i++) {
+            if (line[at] != ' ') {
+                return nesting;
+            }
+            at++;
+        }
+        nesting++;
+    }
+    return nesting;
 }
 
-void Lexer::eat_spaces()
+size_t Lexer::skip_spaces(std::string_view line, size_t at)
 {
-    while (char c = lookup()) {
-        if (c != ' ') {
-            return;
-        }
-        eat();
+    while (at < line.size() && line[at] == ' ') {
+        at++;
     }
+    return at;
 }
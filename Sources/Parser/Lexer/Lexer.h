@@ -1,14 +1,17 @@
 #pragma once
+#include "../../Utils/Arena.h"
 #include "Token.h"
 
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// The file is mapped into memory and tokens are slices of it,
+// only words with escapes are copied, into the context's arena.
 class Lexer {
 public:
     Lexer() = default;
-    explicit Lexer(const std::string& path);
+    Lexer(const std::string& path, Arena& arena);
     ~Lexer();
 
     Lexer(const Lexer&) = delete;
@@ -36,40 +39,21 @@ public:
     }
 
 private:
-    int calc_nesting_for_cur_line();
-    bool next_string();
-    void eat_spaces();
+    void unmap();
 
-    inline char lookup() const
-    {
-        if (m_line_idx < m_cur_line.size()) {
-            return m_cur_line[m_line_idx];
-        }
-        return 0;
-    }
-
-    inline char eat()
-    {
-        char c = lookup();
-        if (c) {
-            m_line_idx++;
-        }
-        return c;
-    }
-
-    inline size_t chars_remain() const
-    {
-        return m_cur_line.size() - m_line_idx;
-    }
+    void lex_line(std::string_view line);
+    size_t lex_word(std::string_view line, size_t at, int nesting);
+    static int calc_nesting(std::string_view line, size_t& at);
+    static size_t skip_spaces(std::string_view line, size_t at);
 
 private:
     std::string m_path {};
-    std::ifstream m_stream {};
-    std::size_t m_line_idx {};
-    std::string m_cur_line {};
+    Arena* m_arena {};
+    const char* m_data {};
+    std::size_t m_size {};
 
     std::size_t m_token_line { 1 };
     std::vector<Token> m_tokens {};
 
     std::vector<size_t> m_variables {};
-};
\ No newline at end of file
+};
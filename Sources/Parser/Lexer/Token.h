@@ -1,6 +1,7 @@
 #pragma once
-#include <memory>
+#include <array>
 #include <string>
+#include <string_view>
 #include <utility>
 
 class Parser;
@@ -21,8 +22,9 @@ public:
     };
 
 public:
-    Token(std::string content, Type type, int nesting, size_t line)
-        : m_content(new std::string(std::move(content)))
+    // The content is a slice of the mapped file or of the context's arena, both outlive the tokens
+    Token(std::string_view content, Type type, int nesting, size_t line)
+        : m_content(content)
         , m_type(type)
         , m_nesting(nesting)
         , m_line(line)
@@ -36,33 +38,12 @@ public:
     {
     }
 
-    static Token TokenFromChar(char c, int nesting, size_t line)
+    static constexpr Type token_type(char c)
     {
-        return Token(token_type(c), nesting, line);
+        return CharTypes[static_cast<unsigned char>(c)];
     }
 
-    static Type token_type(char c)
-    {
-        switch (c) {
-        case ',':
-            return Type::Comma;
-        case ':':
-            return Type::SubRule;
-        case '~':
-            return Type::Equal;
-        case '{':
-            return Type::VariableBegin;
-        case '}':
-            return Type::VariableEnd;
-        }
-        return Type::Default;
-    }
-
-    auto& content() { return *m_content; }
-    const auto& content() const { return *m_content; }
-
-    auto& content_ptr() { return m_content; }
-    const auto& content_ptr() const { return m_content; }
+    std::string_view content() const { return m_content; }
 
     Type type() const { return m_type; }
     int nesting() const { return m_nesting; }
@@ -79,13 +60,24 @@ public:
         if (m_type == Type::Equal) {
             return "Equal";
         }
-        return "[" + content() + "]";
+        return "[" + std::string(content()) + "]";
     }
 
 private:
-    std::shared_ptr<std::string> m_content {};
+    static constexpr std::array<Type, 256> CharTypes = [] {
+        std::array<Type, 256> types {};
+        types[','] = Type::Comma;
+        types[':'] = Type::SubRule;
+        types['~'] = Type::Equal;
+        types['{'] = Type::VariableBegin;
+        types['}'] = Type::VariableEnd;
+        return types;
+    }();
+
+private:
+    std::string_view m_content {};
     Type m_type;
     int m_nesting;
 
     size_t m_line {};
-};
\ No newline at end of file
+};
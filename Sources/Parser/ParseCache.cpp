@@ -0,0 +1,333 @@
+#include "ParseCache.h"
+
+#include "../Config.h"
+#include "../Context.h"
+#include "../Utils/Hash.h"
+#include "../Utils/Utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using StringList = std::vector<std::shared_ptr<std::string>>;
+
+class Writer {
+public:
+    void number(uint64_t value) { m_data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void string(const std::string& string)
+    {
+        number(string.size());
+        m_data += string;
+    }
+
+    // A missing compiler, linker or archiver is stored apart from an empty one
+    void optional_string(const std::shared_ptr<std::string>& string)
+    {
+        number(string != nullptr);
+        if (string) {
+            this->string(*string);
+        }
+    }
+
+    void list(const StringList& list)
+    {
+        number(list.size());
+        for (auto& string : list) {
+            this->string(*string);
+        }
+    }
+
+    void defines(DefinesField& defines)
+    {
+        number(defines.defines().size());
+        for (auto& [key, values] : defines.defines()) {
+            string(key);
+            list(values);
+        }
+    }
+
+    const std::string& data() const { return m_data; }
+
+private:
+    std::string m_data {};
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : m_data(data)
+    {
+    }
+
+    bool failed() const { return m_failed; }
+    bool finished() const { return !m_failed && m_data.empty(); }
+
+    uint64_t number()
+    {
+        uint64_t value = 0;
+        if (m_data.size() < sizeof(value)) {
+            m_failed = true;
+            return 0;
+        }
+        memcpy(&value, m_data.data(), sizeof(value));
+        m_data.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    std::shared_ptr<std::string> string()
+    {
+        auto size = number();
+        if (m_failed || size > m_data.size()) {
+            m_failed = true;
+            return std::make_shared<std::string>();
+        }
+        auto string = std::make_shared<std::string>(m_data.substr(0, size));
+        m_data.remove_prefix(size);
+        return string;
+    }
+
+    std::shared_ptr<std::string> optional_string()
+    {
+        return number() ? string() : nullptr;
+    }
+
+    StringList list()
+    {
+        StringList list {};
+        for (auto count = number(); count && !m_failed; count--) {
+            list.push_back(string());
+        }
+        return list;
+    }
+
+    DefinesField defines()
+    {
+        DefinesField defines {};
+        for (auto count = number(); count && !m_failed; count--) {
+            auto key = string();
+            defines.write_defines(*key, list());
+        }
+        return defines;
+    }
+
+private:
+    std::string_view m_data {};
+    bool m_failed {};
+};
+
+// Keys are sorted, the order of an unordered_map can't be part of a hash
+static uint64_t HashDefines(uint64_t seed, DefinesField& defines)
+{
+    std::vector<const std::string*> keys {};
+    for (auto& [key, values] : defines.defines()) {
+        keys.push_back(&key);
+    }
+    std::sort(keys.begin(), keys.end(), [](auto a, auto b) { return *a < *b; });
+
+    for (auto key : keys) {
+        seed = Hash::String(*key, seed);
+        auto& values = defines.defines()[*key];
+        seed = Hash::Combine(seed, values.size());
+        for (auto& value : values) {
+            seed = Hash::String(*value, seed);
+        }
+    }
+    return seed;
+}
+
+// Flags without a value can't satisfy a conditional define, so they don't change the parse
+static uint64_t HashFlags(uint64_t seed)
+{
+    std::vector<std::pair<std::string, std::string>> flags {};
+    for (auto& [key, value] : Config::the().flags()) {
+        if (!value.empty()) {
+            flags.emplace_back(key, value);
+        }
+    }
+    std::sort(flags.begin(), flags.end());
+
+    for (auto& [key, value] : flags) {
+        seed = Hash::String(value, Hash::String(key, seed));
+    }
+    return Hash::Combine(seed, flags.size());
+}
+
+ParseCache::ParseCache(Context* context)
+    : m_context(context)
+{
+    auto path = context->m_path.lexically_normal().string();
+    m_cache_path = std::filesystem::path(CacheFolder) / (Hash::ToHex(Hash::String(path)) + ".macainfo");
+
+    // the inherited defines are all the context knows before it's parsed
+    if (auto content = Hash::File(context->m_path)) {
+        m_key = HashDefines(HashFlags(Hash::Combine(*content, Version)), context->m_defines);
+    }
+}
+
+bool ParseCache::load()
+{
+    if (!m_key) {
+        return false;
+    }
+
+    int fd = open(m_cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat {};
+    std::string content {};
+    if (fstat(fd, &file_stat) == 0) {
+        content.resize(file_stat.st_size);
+    }
+    bool read = Utils::ReadAll(fd, content.data(), content.size());
+    close(fd);
+
+    Reader reader(content);
+    if (!read || reader.number() != *m_key) {
+        return false;
+    }
+
+    IncludeField include {};
+    for (auto& path : reader.list()) {
+        include.add_path(path);
+    }
+
+    CommandsField commands {};
+    for (auto count = reader.number(); count && !reader.failed(); count--) {
+        auto name = reader.string();
+        for (auto& part : reader.list()) {
+            commands.append_to_command(*name, part);
+        }
+        // a command can be declared with nothing to run
+        commands.command_list(*name);
+    }
+
+    BuildField build {};
+    build.set_type(static_cast<BuildField::Type>(reader.number()));
+    for (auto& dependency : reader.list()) {
+        build.add_dependency(dependency);
+    }
+    for (auto& header_folder : reader.list()) {
+        build.add_header_folder(header_folder);
+    }
+    for (auto& source : reader.list()) {
+        build.add_source(source);
+    }
+    for (auto count = reader.number(); count && !reader.failed(); count--) {
+        auto extension = reader.string();
+        if (auto compiler = reader.optional_string()) {
+            build.set_compiler_to_extension(extension, compiler);
+        }
+        for (auto& flag : reader.list()) {
+            build.add_flag_to_extension(extension, flag);
+        }
+        bool object_flags = reader.number();
+        auto flags = reader.list();
+        if (object_flags) {
+            build.set_object_flags_to_extension(extension, std::move(flags));
+        }
+    }
+    build.set_archiver(reader.optional_string());
+    build.set_linker(reader.optional_string());
+    for (auto& flag : reader.list()) {
+        build.add_linker_flag(flag);
+    }
+
+    DefaultField default_field {};
+    for (auto& command : reader.list()) {
+        default_field.add_command_to_sequence(command);
+    }
+
+    auto defines = reader.defines();
+
+    std::vector<Context::Spawn> spawns {};
+    for (auto count = reader.number(); count && !reader.failed(); count--) {
+        auto operation = static_cast<Context::Operation>(reader.number());
+        auto line = reader.number();
+        auto patterns = reader.list();
+        spawns.push_back({ .operation = operation, .line = line, .patterns = std::move(patterns), .defines = reader.defines() });
+    }
+
+    if (!reader.finished()) {
+        return false;
+    }
+
+    m_context->m_include = std::move(include);
+    m_context->m_commands = std::move(commands);
+    m_context->m_build = std::move(build);
+    m_context->m_default = std::move(default_field);
+
+    // children get the defines they would have got while parsing
+    for (auto& spawn : spawns) {
+        m_context->m_defines = std::move(spawn.defines);
+        // a failed spawn leaves the context with its error, parsing again would only repeat it
+        if (!m_context->spawn_children(spawn.patterns, spawn.operation, spawn.line)) {
+            return true;
+        }
+    }
+    m_context->m_defines = std::move(defines);
+    return true;
+}
+
+void ParseCache::store()
+{
+    if (!m_key) {
+        return;
+    }
+
+    Writer writer {};
+    writer.number(*m_key);
+
+    writer.list(m_context->m_include.paths());
+
+    writer.number(m_context->m_commands.commands().size());
+    for (auto& [name, parts] : m_context->m_commands.commands()) {
+        writer.string(name);
+        writer.list(parts);
+    }
+
+    auto& build = m_context->m_build;
+    writer.number(static_cast<uint64_t>(build.type()));
+    writer.list(build.depends());
+    writer.list(build.header_folders());
+    writer.list(build.sources());
+    writer.number(build.extensions().size());
+    for (auto& [extension, option] : build.extensions()) {
+        writer.string(extension);
+        writer.optional_string(option.compiler);
+        writer.list(option.flags);
+        writer.number(option.object_flags.has_value());
+        writer.list(option.object_flags.value_or(std::vector<std::shared_ptr<std::string>> {}));
+    }
+    writer.optional_string(build.archiver());
+    writer.optional_string(build.linker());
+    writer.list(build.linker_flags());
+
+    writer.list(m_context->m_default.sequence());
+    writer.defines(m_context->m_defines);
+
+    writer.number(m_context->m_spawns.size());
+    for (auto& spawn : m_context->m_spawns) {
+        writer.number(static_cast<uint64_t>(spawn.operation));
+        writer.number(spawn.line);
+        writer.list(spawn.patterns);
+        writer.defines(spawn.defines);
+    }
+
+    // written aside and renamed, contexts of the same file in concurrent builds never see half a cache
+    std::error_code error {};
+    std::filesystem::create_directories(CacheFolder, error);
+    auto temporary = m_cache_path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(gettid());
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    bool written = Utils::WriteAll(fd, writer.data().data(), writer.data().size());
+    close(fd);
+    if (!written || rename(temporary.c_str(), m_cache_path.c_str()) < 0) {
+        unlink(temporary.c_str());
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * ParseCache keeps the fields of every parsed .maca file in MacaBuild/parsed/, keyed on the
+ * file's content, the flags and the defines it inherits. An unchanged file is loaded from
+ * there without running the Lexer and the Parser, only its Include and Depends lists are run again.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+class Context;
+
+class ParseCache {
+    static constexpr auto CacheFolder = "MacaBuild/parsed";
+    static constexpr uint64_t Version = 2;
+
+public:
+    explicit ParseCache(Context* context);
+
+    // Fills the context's fields and runs its children, false if nothing is cached for the file as it is
+    bool load();
+    void store();
+
+private:
+    Context* m_context {};
+    std::string m_cache_path {};
+    std::optional<uint64_t> m_key {};
+};
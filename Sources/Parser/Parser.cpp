@@ -9,7 +9,7 @@
 Parser::Parser(const std::string& path, Context* context)
     : context(context)
 {
-    lexer = Lexer(path);
+    lexer = Lexer(path, context->m_arena);
 }
 
 Parser::Parser(Parser&& parser) noexcept
@@ -32,16 +32,15 @@ void Parser::run()
     process_variables(false);
 
     while (auto token = lookup()) {
-        if (token->type() != Token::Type::Default || !token->content_ptr()) {
+        if (token->type() != Token::Type::Default || token->content().empty()) {
             trigger_error_on_line(token->line(), "met unexpected token " + token->to_string());
+            return;
         }
         if (token->content() == "Include") {
             parse_include();
             // as soon as include list is parsed, we are ready to process other files in different threads
-            for (auto& path : context->m_include.paths()) {
-                if (!context->run_as_childs(*path, Context::Operation::Parse)) {
-                    trigger_error_on_line(token->line(), "Included path \"" + *path + "\" does not exist");
-                }
+            if (context->failed() || !context->spawn_children(context->m_include.paths(), Context::Operation::Parse, token->line())) {
+                return;
             }
         } else if (token->content() == "Define") {
             parse_defines();
@@ -54,13 +53,26 @@ void Parser::run()
             parse_default();
         } else {
             trigger_error_on_line(token->line(), "met unexpected token " + token->to_string());
-            break;
+        }
+
+        // an error in the server or watch mode, the rest of the file isn't needed
+        if (context->failed()) {
+            return;
         }
     }
 
     process_variables(true);
 }
 
+// The error fails the context, and the rest of the tokens is skipped, so that the parsing unwinds
+void Parser::trigger_error_on_line(size_t line, const std::string& error)
+{
+    m_tokens_idx = lexer.tokens().size();
+    if (!context->failed()) {
+        context->trigger_error("line " + std::to_string(line) + ": " + error);
+    }
+}
+
 void Parser::parse_include()
 {
     eat(); // Include
@@ -80,7 +92,7 @@ void Parser::parse_defines()
 
     std::function<void(int, bool)> parse_define_paris = [&](int nesting, bool save_result) {
         parse_line_by_line(nesting, [&](const Token& key_or_lhs) {
-            if (lookup()->type() == Token::Type::SubRule) {
+            if (lookup() && lookup()->type() == Token::Type::SubRule) {
                 eat();
                 std::vector<std::shared_ptr<std::string>> defines;
                 parse_argument_list_of_rule(*lookup(-1), [&](const std::shared_ptr<std::string>& content) {
@@ -89,19 +101,23 @@ void Parser::parse_defines()
                     }
                 });
                 if (save_result) {
-                    context->m_defines.write_defines(key_or_lhs.content(), std::move(defines));
+                    context->m_defines.write_defines(std::string(key_or_lhs.content()), std::move(defines));
                 }
                 return;
             }
 
-            if (lookup()->type() == Token::Type::Equal) {
+            if (lookup() && lookup()->type() == Token::Type::Equal) {
                 eat();
                 auto rhs = eat();
                 if (!rhs || rhs->line() != key_or_lhs.line()) {
                     trigger_error_on_line(key_or_lhs.line(), "no right hand sight for equal operation");
+                    return;
                 }
                 eat_sub_rule_hard();
-                parse_define_paris(nesting + 1, Config::the().flags()[key_or_lhs.content()] == rhs->content());
+                // looked up without inserting, the flags are shared by all parsing threads
+                auto& flags = Config::the().flags();
+                auto flag = flags.find(std::string(key_or_lhs.content()));
+                parse_define_paris(nesting + 1, flag != flags.end() && flag->second == rhs->content());
                 return;
             }
 
@@ -120,7 +136,7 @@ void Parser::parse_commands()
     parse_line_by_line(1, [this](const Token& cmd) {
         eat_sub_rule_hard();
         parse_argument_list([&](const std::shared_ptr<std::string>& content) {
-            context->m_commands.append_to_command(cmd.content(), content);
+            context->m_commands.append_to_command(std::string(cmd.content()), content);
         });
     });
 }
@@ -134,7 +150,7 @@ void Parser::parse_build()
         if (build_subfield.content() == "Type") {
             eat_sub_rule_hard();
             auto type = parse_single_argument(build_subfield.line());
-            if (!context->m_build.set_type(*type)) {
+            if (!type || !context->m_build.set_type(*type)) {
                 trigger_error_on_line(build_subfield.line(), "incorrect type (choose either StaticLib or Executable)");
             }
         } else if (build_subfield.content() == "Depends") {
@@ -143,10 +159,8 @@ void Parser::parse_build()
                 context->m_build.add_dependency(dependency);
             });
             // as soon as depends list is parsed, we are ready to process referenced files in different threads
-            for (auto& dependency : context->m_build.depends()) {
-                if (!context->run_as_childs(*dependency, Context::Operation::Build)) {
-                    trigger_error_on_line(build_subfield.line(), "referenced dependency \"" + *dependency + "\" does not exist");
-                }
+            if (context->failed() || !context->spawn_children(context->m_build.depends(), Context::Operation::Build, build_subfield.line())) {
+                return;
             }
         } else if (build_subfield.content() == "HeaderFolders") {
             eat_sub_rule_hard();
@@ -162,10 +176,11 @@ void Parser::parse_build()
             eat_sub_rule_hard();
             parse_line_by_line(2, [&](const Token& extension) {
                 eat_sub_rule_hard();
+                auto extension_name = std::make_shared<std::string>(extension.content());
 
                 bool options_specified = false;
 
-                for (size_t i = 0; i < 2; i++) {
+                for (size_t i = 0; i < 3; i++) {
                     auto compiler_or_flag = parse_single_argument_of_rule(extension);
                     if (compiler_or_flag) {
                         options_specified = true;
@@ -173,16 +188,24 @@ void Parser::parse_build()
                             eat_sub_rule_hard();
                             auto compiler = parse_single_argument(extension.line());
                             if (!compiler) {
-                                trigger_error_on_line(extension.line(), " no compiler is specified");
+                                trigger_error_on_line(extension.line(), "no compiler is specified");
+                                return;
                             }
-                            if (!context->m_build.set_compiler_to_extension(extension.content_ptr(), compiler)) {
+                            if (!context->m_build.set_compiler_to_extension(extension_name, compiler)) {
                                 trigger_error_on_line(extension.line(), "compiler redefinition");
                             }
                         } else if (*compiler_or_flag == "Flags") {
                             eat_sub_rule_hard();
                             parse_argument_list([&](const std::shared_ptr<std::string>& flag) {
-                                context->m_build.add_flag_to_extension(extension.content_ptr(), flag);
+                                context->m_build.add_flag_to_extension(extension_name, flag);
+                            });
+                        } else if (*compiler_or_flag == "ObjectFlags") {
+                            eat_sub_rule_hard();
+                            std::vector<std::shared_ptr<std::string>> object_flags {};
+                            parse_argument_list([&](const std::shared_ptr<std::string>& flag) {
+                                object_flags.push_back(flag);
                             });
+                            context->m_build.set_object_flags_to_extension(extension_name, std::move(object_flags));
                         } else {
                             trigger_error_on_line(extension.line(), "invalid option for extension - " + *compiler_or_flag);
                         }
@@ -211,7 +234,7 @@ void Parser::parse_build()
                         context->m_build.add_linker_flag(flag);
                     });
                 } else {
-                    trigger_error_on_line(linker_or_flags.line(), "unknown Link option \"" + linker_or_flags.content() + "\"");
+                    trigger_error_on_line(linker_or_flags.line(), "unknown Link option \"" + std::string(linker_or_flags.content()) + "\"");
                 }
             });
         } else if (build_subfield.content() == "Archiver") {
@@ -223,7 +246,7 @@ void Parser::parse_build()
                 context->m_build.set_archiver(archiver);
             }
         } else {
-            trigger_error_on_line(build_subfield.line(), "met unexpected Build subfield \"" + build_subfield.content() + "\"");
+            trigger_error_on_line(build_subfield.line(), "met unexpected Build subfield \"" + std::string(build_subfield.content()) + "\"");
         }
     });
 }
@@ -300,7 +323,27 @@ void Parser::parse_argument_list_of_rule(const Token& rule, TokenContentProcesso
 
 void Parser::parse_lined_argument_list(size_t line, TokenContentProcessor process_content)
 {
-    std::shared_ptr<std::string> arg = nullptr;
+    // an argument stays a slice of the file, or the value of a define, until parts are glued together in the arena
+    std::string_view arg {};
+    std::shared_ptr<std::string> define_value {};
+    bool has_arg = false;
+
+    auto append = [&](std::string_view part, const std::shared_ptr<std::string>& value) {
+        if (!has_arg) {
+            arg = part;
+            define_value = value;
+            has_arg = true;
+        } else {
+            arg = context->m_arena.concat(arg, part);
+            define_value = nullptr;
+        }
+    };
+
+    auto flush = [&]() {
+        process_content(define_value ? define_value : std::make_shared<std::string>(arg));
+        define_value = nullptr;
+        has_arg = false;
+    };
 
     while (lookup()) {
         if (lookup()->line() != line) {
@@ -308,47 +351,38 @@ void Parser::parse_lined_argument_list(size_t line, TokenContentProcessor proces
         }
 
         if (lookup()->type() == Token::Type::Comma) {
-            if (arg) {
-                process_content(arg);
-                arg = nullptr;
-                eat();
+            if (has_arg) {
+                flush();
             }
+            eat();
             continue;
         }
 
         if (lookup()->type() == Token::Type::Default) {
-            if (!arg) {
-                arg = eat()->content_ptr();
-            } else {
-                arg = std::make_shared<std::string>(*arg + eat()->content());
-            }
+            append(eat()->content(), nullptr);
             continue;
         }
 
         if (lookup()->type() == Token::Type::Variable) {
             auto variable_token = eat();
-            auto& variable_name = variable_token->content();
+            auto variable_name = std::string(variable_token->content());
             if (variable_name.empty()) {
                 trigger_error_on_line(variable_token->line(), "variable has no name");
+                return;
             }
             if (!context->m_defines.defines().contains(variable_name)) {
                 trigger_error_on_line(variable_token->line(), "variable " + variable_name + " was not defined");
+                return;
             }
 
             auto& define_list = context->m_defines.defines()[variable_name];
 
             for (size_t i = 0 ; i < define_list.size() ; i++) {
                 auto& content = define_list[i];
-
-                if (!arg) {
-                    arg = content;
-                } else {
-                    arg = std::make_shared<std::string>(*arg + *content);
-                }
+                append(*content, content);
 
                 if (i < define_list.size() - 1) {
-                    process_content(arg);
-                    arg = nullptr;
+                    flush();
                 }
             }
 
@@ -358,8 +392,8 @@ void Parser::parse_lined_argument_list(size_t line, TokenContentProcessor proces
         break;
     }
 
-    if (arg) {
-        process_content(arg);
+    if (has_arg) {
+        flush();
     }
 }
 
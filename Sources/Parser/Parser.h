@@ -50,8 +50,10 @@ private:
 private:
     inline void eat_sub_rule_hard()
     {
-        if (lookup()->type() != Token::Type::SubRule) {
-            trigger_error_on_line(lookup()->line(), "SubRule expected");
+        auto token = lookup();
+        if (!token || token->type() != Token::Type::SubRule) {
+            trigger_error_on_line(token ? token->line() : lookup(-1)->line(), "SubRule expected");
+            return;
         }
         eat(); // SubRule
     }
@@ -74,11 +76,7 @@ private:
         return token;
     }
 
-    void trigger_error_on_line(size_t line, const std::string& error)
-    {
-        Log(Color::Red, lexer.path() + ", line", line, error);
-        exit(1);
-    }
+    void trigger_error_on_line(size_t line, const std::string& error);
 
 private:
     Context* context {};
@@ -0,0 +1,82 @@
+#include "Profiler.h"
+
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static constexpr const char* PhaseNames[] = {
+    "parse .maca",
+    "glob",
+    "include scan",
+    "timestamps load",
+    "timestamps save",
+    "wait on children",
+    "jobs",
+};
+
+static std::string Milliseconds(uint64_t nanoseconds)
+{
+    std::ostringstream text {};
+    text << std::fixed << std::setprecision(nanoseconds < 10'000'000 ? 3 : 1) << nanoseconds / 1e6 << " ms";
+    return text.str();
+}
+
+Profiler::Samples& Profiler::local()
+{
+    // a thread's buffer outlives it, the report may come after the thread is gone
+    static thread_local Samples* samples {};
+    if (!samples) {
+        auto _ = ScopedLocker(m_lock);
+        samples = m_samples.emplace_back(std::make_unique<Samples>()).get();
+    }
+    return *samples;
+}
+
+void Profiler::record(Phase phase, std::chrono::steady_clock::duration duration)
+{
+    auto& samples = local();
+    auto _ = ScopedLocker(samples.lock);
+    samples.durations[static_cast<size_t>(phase)].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+void Profiler::report()
+{
+    std::array<std::vector<uint64_t>, static_cast<size_t>(Phase::Count)> merged {};
+    {
+        auto _ = ScopedLocker(m_lock);
+        for (auto& samples : m_samples) {
+            auto _ = ScopedLocker(samples->lock);
+            for (size_t phase = 0; phase < merged.size(); phase++) {
+                auto& durations = samples->durations[phase];
+                merged[phase].insert(merged[phase].end(), durations.begin(), durations.end());
+                durations.clear();
+            }
+        }
+    }
+
+    if (!m_enabled) {
+        return;
+    }
+
+    // phases of different threads overlap, so the totals may add up to more than the run took
+    Log(Color::Magenta, "Profile (phase, count, total, p95):");
+    for (size_t phase = 0; phase < merged.size(); phase++) {
+        auto& durations = merged[phase];
+        if (durations.empty()) {
+            continue;
+        }
+        uint64_t total = 0;
+        for (auto duration : durations) {
+            total += duration;
+        }
+        auto p95 = durations.begin() + (durations.size() * 95 + 99) / 100 - 1;
+        std::nth_element(durations.begin(), p95, durations.end());
+
+        std::ostringstream line {};
+        line << std::left << std::setw(18) << PhaseNames[phase] << std::right << std::setw(8) << durations.size();
+        line << std::setw(14) << Milliseconds(total) << std::setw(14) << Milliseconds(*p95);
+        Log(Color::Blue, line.str());
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Profiler breaks a run down into phases ("--profile"): parsing .maca files, globbing,
+ * include scanning, the timestamp database, waiting on children and executing jobs.
+ * Every thread records durations into a buffer of its own, the buffers are merged into
+ * the count, the total and the p95 of every phase only when the report is printed.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Profiler {
+public:
+    enum class Phase : uint8_t {
+        Parse,
+        Glob,
+        IncludeScan,
+        TimestampLoad,
+        TimestampSave,
+        WaitChildren,
+        Job,
+        Count,
+    };
+
+public:
+    static Profiler& the()
+    {
+        static auto instance = Profiler();
+        return instance;
+    }
+
+    bool enabled() const { return m_enabled; }
+    void set_enabled(bool enabled) { m_enabled = enabled; }
+
+    void record(Phase phase, std::chrono::steady_clock::duration duration);
+
+    // Prints the phases recorded since the last report
+    void report();
+
+private:
+    // Only its own thread records into it, the lock is taken by the report otherwise
+    struct Samples {
+        SpinLock lock {};
+        std::array<std::vector<uint64_t>, static_cast<size_t>(Phase::Count)> durations {};
+    };
+
+private:
+    Profiler() = default;
+
+    Samples& local();
+
+private:
+    bool m_enabled {};
+    SpinLock m_lock {};
+    std::vector<std::unique_ptr<Samples>> m_samples {};
+};
+
+// Records the time until the end of the scope, nothing is done without "--profile"
+class ProfileScope {
+public:
+    explicit ProfileScope(Profiler::Phase phase)
+        : m_phase(phase)
+    {
+        if (Profiler::the().enabled()) {
+            m_started = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (m_started != std::chrono::steady_clock::time_point {}) {
+            Profiler::the().record(m_phase, std::chrono::steady_clock::now() - m_started);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler::Phase m_phase {};
+    std::chrono::steady_clock::time_point m_started {};
+};
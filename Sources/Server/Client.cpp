@@ -0,0 +1,69 @@
+#include "Client.h"
+#include "../Utils/Logger.h"
+#include "../Utils/Utils.h"
+#include "Server.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Client {
+
+std::optional<int> forward(int argc, char** argv)
+{
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        return {};
+    }
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, Server::SocketPath, sizeof(address.sun_path) - 1);
+
+    // no server (or a stale socket of a dead one), the build is done locally
+    if (connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(connection);
+        return {};
+    }
+
+    std::string request;
+    for (int at = 1; at < argc; at++) {
+        request.append(argv[at]);
+        request.push_back('\0');
+    }
+    uint32_t size = request.size();
+
+    // standard streams are handed over along with the request size,
+    // so that the server and the commands it runs use them directly
+    int descriptors[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))] {};
+
+    iovec vector { .iov_base = &size, .iov_len = sizeof(size) };
+    msghdr message {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+    memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    int32_t status = 1;
+    if (sendmsg(connection, &message, 0) != sizeof(size)
+        || !Utils::WriteAll(connection, request.data(), request.size())
+        || !Utils::ReadAll(connection, &status, sizeof(status))) {
+        Log(Color::Red, "lost connection to the build server");
+        status = 1;
+    }
+
+    close(connection);
+    return status;
+}
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <optional>
+
+namespace Client {
+
+// Runs the command line on a build server if one is listening in the current folder,
+// returns its exit status or nothing if the build has to be done by this process.
+std::optional<int> forward(int argc, char** argv);
+
+}
@@ -0,0 +1,250 @@
+#include "Server.h"
+#include "../Cache/ObjectCache.h"
+#include "../Config.h"
+#include "../Context.h"
+#include "../Finder/Finder.h"
+#include "../Finder/GlobCache.h"
+#include "../Finder/StatCache.h"
+#include "../Utils/Logger.h"
+#include "../Utils/Utils.h"
+#include "../Watcher/Watcher.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+static constexpr auto default_idle_timeout_seconds = 600;
+
+Server::Server(std::filesystem::path root_maca_file)
+    : m_root_maca_file(std::move(root_maca_file))
+{
+    // a server option mustn't be mistaken for a changed define condition
+    m_idle_timeout = Config::the().int_flag("idle", default_idle_timeout_seconds);
+    Config::the().flags().erase("idle");
+}
+
+Server::~Server()
+{
+    unload();
+    if (m_socket >= 0) {
+        close(m_socket);
+        unlink(SocketPath);
+    }
+}
+
+void Server::run()
+{
+    // clients going away in the middle of a build mustn't take the server down
+    signal(SIGPIPE, SIG_IGN);
+    Config::the().set_persistent(true);
+
+    listen_socket();
+    load();
+
+    Log(Color::Magenta, "Serving builds of", m_root_maca_file.string(), "at", SocketPath);
+    Logger::the().flush();
+
+    for (;;) {
+        pollfd descriptor {};
+        descriptor.fd = m_socket;
+        descriptor.events = POLLIN;
+        int ready = poll(&descriptor, 1, m_idle_timeout * 1000);
+        if (ready == 0) {
+            Log(Color::Magenta, "No builds requested for", m_idle_timeout, "seconds, shutting down");
+            unlink(SocketPath);
+            ObjectCache::the().flush();
+            GlobCache::the().save();
+            exit(0);
+        }
+        if (ready < 0) {
+            continue;
+        }
+
+        int connection = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            continue;
+        }
+        handle(connection);
+        close(connection);
+    }
+}
+
+void Server::listen_socket()
+{
+    Finder::CreateDirectory(std::filesystem::path(SocketPath).parent_path());
+    unlink(SocketPath);
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, SocketPath, sizeof(address.sun_path) - 1);
+
+    if (m_socket < 0
+        || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(m_socket, 16) < 0) {
+        Log(Color::Red, "can't listen on", SocketPath, strerror(errno));
+        exit(1);
+    }
+}
+
+void Server::load()
+{
+    m_parsed_flags = Config::the().flags();
+
+    // Contexts process the current mode right after parsing,
+    // which is nothing for the server itself or a client's request otherwise.
+    m_root = new Context(m_root_maca_file, Context::Operation::Build, {}, true);
+    m_root->run();
+    wait_contexts();
+
+    m_watcher = std::make_unique<Watcher>(m_root);
+    m_watcher->watch_directories();
+}
+
+void Server::unload()
+{
+    m_watcher.reset();
+
+    for (auto context : collect_contexts()) {
+        delete context;
+    }
+    m_root = nullptr;
+    Context::unregister_contexts();
+    StatCache::the().clear();
+    GlobCache::the().revalidate();
+}
+
+void Server::wait_contexts()
+{
+    // children are only known once their parents are parsed, so the graph is collected until it settles
+    size_t contexts_count = 0;
+    for (;;) {
+        auto contexts = collect_contexts();
+        bool done = std::all_of(contexts.begin(), contexts.end(), [](Context* context) {
+            return context->done();
+        });
+        if (done && contexts.size() == contexts_count) {
+            return;
+        }
+        contexts_count = contexts.size();
+        std::this_thread::yield();
+    }
+}
+
+void Server::handle(int connection)
+{
+    int descriptors[3];
+    if (!receive_request(connection, descriptors)) {
+        return;
+    }
+
+    m_request_argv.clear();
+    m_request_argv.push_back(const_cast<char*>(Config::the().filename().c_str()));
+    for (auto& argument : m_request) {
+        m_request_argv.push_back(argument.data());
+    }
+    m_request_argv.push_back(nullptr);
+    Config::the().process_arguments(static_cast<int>(m_request_argv.size() - 1), m_request_argv.data());
+
+    // records logged so far belong to the server's own output
+    Logger::the().flush();
+    int saved_descriptors[3];
+    for (int fd = 0; fd < 3; fd++) {
+        saved_descriptors[fd] = dup(fd);
+        dup2(descriptors[fd], fd);
+        close(descriptors[fd]);
+    }
+
+    while (m_watcher->read_events(0)) { }
+
+    // define conditions depend on the flags, so .maca files are reparsed if those differ
+    if (m_watcher->configuration_changed() || Config::the().flags() != m_parsed_flags) {
+        unload();
+        load();
+    } else {
+        m_watcher->apply_changes();
+        m_watcher->rerun();
+        while (!m_watcher->done()) {
+            std::this_thread::yield();
+        }
+        m_watcher->watch_directories();
+    }
+
+    int32_t status = m_root->failed() ? 1 : 0;
+    GlobCache::the().save();
+
+    Logger::the().flush();
+    std::cerr.flush();
+    for (int fd = 0; fd < 3; fd++) {
+        dup2(saved_descriptors[fd], fd);
+        close(saved_descriptors[fd]);
+    }
+
+    Utils::WriteAll(connection, &status, sizeof(status));
+}
+
+bool Server::receive_request(int connection, int (&descriptors)[3])
+{
+    uint32_t size = 0;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))] {};
+
+    iovec vector { .iov_base = &size, .iov_len = sizeof(size) };
+    msghdr message {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(connection, &message, MSG_CMSG_CLOEXEC) != sizeof(size)) {
+        return false;
+    }
+
+    auto header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(descriptors))) {
+        return false;
+    }
+    memcpy(descriptors, CMSG_DATA(header), sizeof(descriptors));
+
+    std::string request(size, '\0');
+    if (!Utils::ReadAll(connection, request.data(), request.size())) {
+        for (int fd : descriptors) {
+            close(fd);
+        }
+        return false;
+    }
+
+    m_request.clear();
+    size_t begin = 0;
+    for (size_t at = 0; at < request.size(); at++) {
+        if (request[at] == '\0') {
+            m_request.push_back(request.substr(begin, at - begin));
+            begin = at + 1;
+        }
+    }
+    return true;
+}
+
+std::vector<Context*> Server::collect_contexts() const
+{
+    std::vector<Context*> contexts {};
+    if (!m_root) {
+        return contexts;
+    }
+
+    contexts.push_back(m_root);
+    for (size_t at = 0; at < contexts.size(); at++) {
+        for (auto child : contexts[at]->children()) {
+            if (std::find(contexts.begin(), contexts.end(), child) == contexts.end()) {
+                contexts.push_back(child);
+            }
+        }
+    }
+    return contexts;
+}
@@ -0,0 +1,49 @@
+/*
+ * Server keeps the parsed contexts of a project warm between builds.
+ * Macabuilder binaries launched in the same folder forward their arguments
+ * to it over a unix socket together with their stdout and stderr descriptors.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Context;
+class Watcher;
+
+class Server {
+public:
+    static constexpr auto SocketPath = "MacaBuild/server.sock";
+
+public:
+    explicit Server(std::filesystem::path root_maca_file);
+    ~Server();
+
+    [[noreturn]] void run();
+
+private:
+    void listen_socket();
+    void load();
+    void unload();
+    void wait_contexts();
+    void handle(int connection);
+    bool receive_request(int connection, int (&descriptors)[3]);
+
+    std::vector<Context*> collect_contexts() const;
+
+private:
+    std::filesystem::path m_root_maca_file {};
+    Context* m_root {};
+    std::unique_ptr<Watcher> m_watcher {};
+    std::unordered_map<std::string, std::string> m_parsed_flags {};
+
+    int m_socket { -1 };
+    int m_idle_timeout {};
+
+    std::vector<std::string> m_request {};
+    std::vector<char*> m_request_argv {};
+};
@@ -0,0 +1,296 @@
+#include "NinjaTranslator.h"
+
+#include "../Config.h"
+#include "../Context.h"
+#include "../Finder/GlobCache.h"
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// Paths in build and default lines
+static std::string NinjaPath(const std::string& path)
+{
+    std::string escaped {};
+    for (char symbol : path) {
+        if (symbol == '$' || symbol == ' ' || symbol == ':') {
+            escaped += '$';
+        }
+        escaped += symbol;
+    }
+    return escaped;
+}
+
+// Variable values, only '$' is special there
+static std::string NinjaValue(const std::string& value)
+{
+    std::string escaped {};
+    for (char symbol : value) {
+        if (symbol == '$') {
+            escaped += '$';
+        }
+        escaped += symbol;
+    }
+    return escaped;
+}
+
+// Commands run through sh, arguments are passed to execvp as they are by Macabuilder
+static std::string ShellArgument(const std::string& argument)
+{
+    bool plain = !argument.empty() && std::all_of(argument.begin(), argument.end(), [](char symbol) {
+        return isalnum(static_cast<unsigned char>(symbol)) || strchr("_-+=./,:@%^", symbol);
+    });
+    if (plain) {
+        return argument;
+    }
+
+    std::string quoted = "'";
+    for (char symbol : argument) {
+        if (symbol == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += symbol;
+        }
+    }
+    return quoted + "'";
+}
+
+// The depfile holds paths relative to the folder the compiler ran in, ninja reads them relative to the root:
+// every relative path gets the folder in front, escaped spaces are kept inside of their path
+static std::string RebaseDepfile(const std::string& folder, const std::string& depfile)
+{
+    std::string replacement {};
+    for (char symbol : folder) {
+        if (symbol == '\\' || symbol == '&' || symbol == '#') {
+            replacement += '\\';
+        }
+        replacement += symbol;
+    }
+    auto script = "s/\\\\ /\\x01/g; s#(^|[[:space:]])([^/[:space:]\\])#\\1" + replacement + "/\\2#g; s/\\x01/\\\\ /g";
+    return "sed -E -i " + ShellArgument(script) + " " + ShellArgument(depfile);
+}
+
+// Compilers that can write a depfile with -MD -MF
+static bool GccLike(const std::string& compiler)
+{
+    auto name = std::filesystem::path(compiler).filename().string();
+    return name.find("gcc") != std::string::npos || name.find("g++") != std::string::npos || name.find("clang") != std::string::npos || name == "cc" || name == "c++";
+}
+
+void NinjaTranslator::collect(Context* context)
+{
+    auto cwd = context->cwd();
+    bool in_root = context->directory().empty();
+    auto prefix = in_root ? std::string() : "cd " + ShellArgument(cwd.string()) + " && ";
+
+    // commands run in the folder of the context, paths in the file are relative to the root
+    auto from_root = [&](const std::filesystem::path& path) {
+        return NinjaPath((cwd / path).lexically_normal().string());
+    };
+
+    std::set<std::string> maca_files { context->m_path.lexically_normal().string() };
+    std::vector<const Context*> pending(context->children().begin(), context->children().end());
+    while (!pending.empty()) {
+        auto child = pending.back();
+        pending.pop_back();
+        if (child->operation() == Context::Operation::Parse && maca_files.insert(child->m_path.lexically_normal().string()).second) {
+            pending.insert(pending.end(), child->children().begin(), child->children().end());
+        }
+    }
+
+    std::string edges {};
+    std::vector<std::string> objects {};
+    std::vector<std::string> scanned {};
+    for (auto& file : context->collect_sources()) {
+        auto option = context->m_build.get_option_for_file(file);
+        if (!option) {
+            context->trigger_error("no option for file \"" + file.string() + "\"");
+        }
+
+        auto relative_source = std::filesystem::proximate(file, cwd);
+        auto object = (context->maca_path() / relative_source).string() + ".o";
+        auto relative_object = std::filesystem::proximate(object, cwd).string();
+        objects.push_back(relative_object);
+
+        auto& argv = context->argv_template(*option);
+        auto command = prefix + ShellArgument(argv->compiler());
+        argv->for_each_argument(relative_source.c_str(), relative_object.c_str(), [&](const char* argument) {
+            command += " " + ShellArgument(argument);
+        });
+
+        bool depfile = GccLike(argv->compiler());
+        edges += "build " + from_root(relative_object) + ": " + (depfile ? "compile_depfile " : "compile ") + from_root(relative_source);
+        if (depfile) {
+            command += " -MD -MF " + ShellArgument(relative_object + ".d");
+            if (!in_root) {
+                command += " && " + RebaseDepfile(cwd.string(), relative_object + ".d");
+            }
+        } else {
+            // the headers Macabuilder resolves itself, up to date as of the generation,
+            // so they regenerate the file once they change
+            std::string implicit {};
+            auto source = relative_source.lexically_normal().string();
+            for (auto& dependency : context->dependencies(file)) {
+                scanned.push_back((cwd / dependency).lexically_normal().string());
+                if (dependency != source) {
+                    implicit += " " + from_root(dependency);
+                }
+            }
+            if (!implicit.empty()) {
+                edges += " |" + implicit;
+            }
+        }
+        edges += "\n    cmd = " + NinjaValue(command) + "\n";
+    }
+
+    std::vector<std::string> dependency_libs {};
+    std::string inputs {};
+    std::string order_only {};
+    {
+        auto _ = ScopedLocker(m_lock);
+        for (auto child : context->children()) {
+            if (child->operation() != Context::Operation::Build || m_outputs[child].empty()) {
+                continue;
+            }
+            // executables are built along, but never linked in
+            if (child->build_field().type() == BuildField::Type::StaticLib) {
+                dependency_libs.push_back(std::filesystem::proximate(child->static_library_path(), cwd).string());
+                inputs += " " + NinjaPath(m_outputs[child]);
+            } else {
+                order_only += " " + NinjaPath(m_outputs[child]);
+            }
+        }
+    }
+    if (!order_only.empty()) {
+        order_only = " ||" + order_only;
+    }
+
+    std::string output {};
+    if (!objects.empty()) {
+        std::string command {};
+        std::string rule {};
+        auto& build = context->m_build;
+        if (build.type() == BuildField::Type::StaticLib) {
+            if (!build.archiver()) {
+                context->trigger_error("no Archiver to generate the archive with");
+            }
+            auto lib = std::filesystem::proximate(context->static_library_path(), cwd).string();
+            output = (cwd / lib).lexically_normal().string();
+            rule = "archive";
+
+            // Macabuilder updates archives in place, here a stale member mustn't survive
+            command = prefix + "rm -f " + ShellArgument(lib) + " && " + ShellArgument(*build.archiver()) + " rcs " + ShellArgument(lib);
+            for (auto& object : objects) {
+                command += " " + ShellArgument(object);
+            }
+            for (auto& dependency_lib : dependency_libs) {
+                command += " " + ShellArgument(dependency_lib);
+            }
+        } else {
+            if (!build.linker()) {
+                context->trigger_error("no Linker to generate the executable with");
+            }
+            auto executable = std::filesystem::proximate(context->executable_path(), cwd).string();
+            output = (cwd / executable).lexically_normal().string();
+            rule = "link";
+
+            std::vector<std::string> arguments {};
+            for (auto& flag : build.linker_flags()) {
+                arguments.push_back(*flag);
+            }
+            arguments.insert(arguments.end(), dependency_libs.begin(), dependency_libs.end());
+            arguments.insert(arguments.end(), objects.begin(), objects.end());
+            arguments.insert(arguments.end(), dependency_libs.begin(), dependency_libs.end());
+            arguments.insert(arguments.end(), dependency_libs.begin(), dependency_libs.end());
+            arguments.push_back("-o");
+            arguments.push_back(executable);
+
+            command = prefix + ShellArgument(*build.linker());
+            for (auto& argument : arguments) {
+                command += " " + ShellArgument(argument);
+            }
+        }
+
+        edges += "build " + NinjaPath(output) + ": " + rule;
+        for (auto& object : objects) {
+            edges += " " + from_root(object);
+        }
+        edges += inputs + order_only + "\n    cmd = " + NinjaValue(command) + "\n";
+    }
+
+    auto _ = ScopedLocker(m_lock);
+    m_outputs[context] = output;
+    m_edges[context->m_path.lexically_normal().string()] = std::move(edges);
+    m_maca_files.insert(maca_files.begin(), maca_files.end());
+    m_scanned_files.insert(scanned.begin(), scanned.end());
+}
+
+void NinjaTranslator::generate(Context* root)
+{
+    std::stringstream content {};
+    content << "# Generated by Macabuilder from " << root->m_path.lexically_normal().string() << ", edit the .maca files instead\n\n";
+    content << "ninja_required_version = 1.3\n\n";
+
+    content << "rule compile\n    command = $cmd\n    description = Compiling $in\n\n";
+    content << "rule compile_depfile\n    command = $cmd\n    description = Compiling $in\n    depfile = $out.d\n    deps = gcc\n\n";
+    content << "rule archive\n    command = $cmd\n    description = Archiving $out\n\n";
+    content << "rule link\n    command = $cmd\n    description = Linking $out\n\n";
+
+    // the file is only rewritten when the graph changes, so restat spares the edges depending on it
+    std::vector<std::pair<std::string, std::string>> flags(Config::the().flags().begin(), Config::the().flags().end());
+    std::sort(flags.begin(), flags.end());
+    std::error_code error {};
+    auto executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    auto command = ShellArgument(error ? Config::the().argv()[0] : executable.string()) + " generate ninja";
+    for (auto& [key, value] : flags) {
+        command += " " + ShellArgument(value.empty() ? "--" + key : "-" + key + "~" + value);
+    }
+    content << "rule regenerate\n    command = " << NinjaValue(command) << "\n    description = Regenerating " << NinjaFile << "\n    generator = 1\n    restat = 1\n\n";
+
+    // a source added to a walked folder, or an include added to a file without a depfile, changes the graph
+    content << "build " << NinjaFile << ": regenerate";
+    for (auto& maca_file : m_maca_files) {
+        content << " " << NinjaPath(maca_file);
+    }
+    std::string implicit {};
+    for (auto& scanned_file : m_scanned_files) {
+        implicit += " " + NinjaPath(scanned_file);
+    }
+    for (auto& directory : GlobCache::the().used_directories()) {
+        auto parts = std::filesystem::path(directory);
+        if (std::find(parts.begin(), parts.end(), "MacaBuild") == parts.end()) {
+            implicit += " " + NinjaPath(directory);
+        }
+    }
+    if (!implicit.empty()) {
+        content << " |" << implicit;
+    }
+    content << "\n\n";
+
+    for (auto& [maca_file, edges] : m_edges) {
+        if (!edges.empty()) {
+            content << "# " << maca_file << "\n" << edges << "\n";
+        }
+    }
+
+    if (!m_outputs[root].empty()) {
+        content << "default " << NinjaPath(m_outputs[root]) << "\n";
+    }
+
+    auto ninja_file = root->directory() / NinjaFile;
+    std::ifstream previous(ninja_file);
+    std::stringstream previous_content {};
+    previous_content << previous.rdbuf();
+    if (previous && previous_content.str() == content.str()) {
+        Log(Color::Magenta, "Up to date:", ninja_file.string());
+        return;
+    }
+
+    std::ofstream file(ninja_file, std::ofstream::trunc);
+    file << content.str();
+    Log(Color::Magenta, "Generated:", ninja_file.string());
+}
@@ -0,0 +1,47 @@
+/*
+ * NinjaTranslator writes the whole build graph into build.ninja at the root ("generate ninja"):
+ * every compile, archive and link with the exact command Macabuilder would run,
+ * so ninja and Macabuilder can be compared on the same graph.
+ */
+
+#pragma once
+
+#include "../Utils/Lock.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+class Context;
+
+class NinjaTranslator {
+public:
+    static constexpr auto NinjaFile = "build.ninja";
+
+public:
+    static NinjaTranslator& the()
+    {
+        static auto instance = NinjaTranslator();
+        return instance;
+    }
+
+    // Adds the edges of a context, its children have to be collected already
+    void collect(Context* context);
+
+    // Writes the file, it's left untouched if nothing changed
+    void generate(Context* root);
+
+private:
+    NinjaTranslator() = default;
+
+private:
+    SpinLock m_lock {};
+    // Ordered by the .maca path, so the file is the same whatever order the threads finish in
+    std::map<std::string, std::string> m_edges {};
+    // The archive or the executable of every context, empty if it has no sources
+    std::unordered_map<const Context*, std::string> m_outputs {};
+    std::set<std::string> m_maca_files {};
+    // Sources and headers of the edges without a depfile
+    std::set<std::string> m_scanned_files {};
+};
@@ -62,8 +62,12 @@ void Translator::generate_cmake(Context* ctx, int a)
 
     file << (library ? "add_library" : "add_executable") << "(";
     file << ctx->name();
+    auto exclusions = Finder::GetExclusions(ctx->directory(), ctx->build_field().sources());
     for (auto& source : ctx->build_field().sources()) {
-        auto files = Finder::FindFiles(ctx->directory(), *source);
+        if (Finder::IsExclusion(*source)) {
+            continue;
+        }
+        auto files = Finder::FindFiles(ctx->directory(), *source, exclusions);
         for (auto& filename : files) {
             file << " " << std::filesystem::proximate(filename, ctx->directory()).string();
         }
@@ -0,0 +1,59 @@
+/*
+ * Arena hands out strings living as long as the arena itself. They are bumped out of large
+ * blocks, so the many short strings built while parsing cost neither an allocation nor a
+ * header each. An arena isn't thread safe, every context owns its own one.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class Arena {
+    static constexpr size_t BlockSize = 64 * 1024;
+
+public:
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    std::string_view store(std::string_view string)
+    {
+        auto data = allocate(string.size());
+        memcpy(data, string.data(), string.size());
+        return { data, string.size() };
+    }
+
+    std::string_view concat(std::string_view first, std::string_view second)
+    {
+        auto data = allocate(first.size() + second.size());
+        memcpy(data, first.data(), first.size());
+        memcpy(data + first.size(), second.data(), second.size());
+        return { data, first.size() + second.size() };
+    }
+
+private:
+    char* allocate(size_t size)
+    {
+        // large strings get a block of their own, the current block keeps being filled
+        if (size > BlockSize / 4) {
+            m_large_blocks.push_back(std::make_unique_for_overwrite<char[]>(size));
+            return m_large_blocks.back().get();
+        }
+        if (m_blocks.empty() || m_used + size > BlockSize) {
+            m_blocks.push_back(std::make_unique_for_overwrite<char[]>(BlockSize));
+            m_used = 0;
+        }
+        auto data = m_blocks.back().get() + m_used;
+        m_used += size;
+        return data;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> m_blocks {};
+    std::vector<std::unique_ptr<char[]>> m_large_blocks {};
+    size_t m_used {};
+};
@@ -0,0 +1,165 @@
+#include "Compression.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Compression {
+
+static constexpr size_t min_match = 4;
+static constexpr size_t last_literals = 5;
+static constexpr size_t match_start_limit = 12;
+static constexpr size_t max_offset = 65535;
+static constexpr int hash_bits = 16;
+
+static inline uint32_t read32(const uint8_t* at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static inline void write_length(std::string& out, size_t length)
+{
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+static void write_sequence(std::string& out, const uint8_t* literals, size_t literals_size, size_t offset, size_t match_size)
+{
+    auto literals_token = std::min<size_t>(literals_size, 15);
+    auto match_token = match_size ? std::min<size_t>(match_size - min_match, 15) : 0;
+    out.push_back(static_cast<char>((literals_token << 4) | match_token));
+    if (literals_token == 15) {
+        write_length(out, literals_size - 15);
+    }
+    out.append(reinterpret_cast<const char*>(literals), literals_size);
+
+    // the last sequence consists of literals only
+    if (!match_size) {
+        return;
+    }
+
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_token == 15) {
+        write_length(out, match_size - min_match - 15);
+    }
+}
+
+std::string Compress(const void* data, size_t size)
+{
+    auto in = static_cast<const uint8_t*>(data);
+
+    std::string out {};
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > match_start_limit) {
+        // positions are stored shifted by one, zero marks an empty slot
+        std::vector<uint32_t> table(1 << hash_bits);
+        size_t at = 0;
+
+        while (at < size - match_start_limit) {
+            auto sequence = read32(in + at);
+            auto slot = (sequence * 2654435761U) >> (32 - hash_bits);
+            size_t candidate = table[slot];
+            table[slot] = at + 1;
+
+            if (!candidate || at - (candidate - 1) > max_offset || read32(in + candidate - 1) != sequence) {
+                at++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            while (at > anchor && match > 0 && in[at - 1] == in[match - 1]) {
+                at--;
+                match--;
+            }
+
+            size_t match_size = min_match;
+            while (at + match_size < size - last_literals && in[at + match_size] == in[match + match_size]) {
+                match_size++;
+            }
+
+            write_sequence(out, in + anchor, at - anchor, at - match, match_size);
+            at += match_size;
+            anchor = at;
+        }
+    }
+
+    write_sequence(out, in + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+static inline bool read_length(const uint8_t*& at, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do {
+        if (at >= end) {
+            return false;
+        }
+        byte = *at++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool Decompress(const void* data, size_t data_size, void* out, size_t size)
+{
+    auto at = static_cast<const uint8_t*>(data);
+    auto end = at + data_size;
+    auto begin = static_cast<uint8_t*>(out);
+    auto write = begin;
+    auto write_end = begin + size;
+
+    while (at < end) {
+        auto token = *at++;
+
+        size_t literals_size = token >> 4;
+        if (literals_size == 15 && !read_length(at, end, literals_size)) {
+            return false;
+        }
+        if (literals_size > static_cast<size_t>(end - at) || literals_size > static_cast<size_t>(write_end - write)) {
+            return false;
+        }
+        memcpy(write, at, literals_size);
+        at += literals_size;
+        write += literals_size;
+
+        if (at == end) {
+            break;
+        }
+
+        if (end - at < 2) {
+            return false;
+        }
+        size_t offset = at[0] | (at[1] << 8);
+        at += 2;
+        if (!offset || offset > static_cast<size_t>(write - begin)) {
+            return false;
+        }
+
+        size_t match_size = token & 15;
+        if (match_size == 15 && !read_length(at, end, match_size)) {
+            return false;
+        }
+        match_size += min_match;
+        if (match_size > static_cast<size_t>(write_end - write)) {
+            return false;
+        }
+
+        // the match may overlap the bytes it produces
+        auto match = write - offset;
+        for (size_t copied = 0; copied < match_size; copied++) {
+            *write++ = *match++;
+        }
+    }
+
+    return write == write_end;
+}
+
+}
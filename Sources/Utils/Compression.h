@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Compression {
+
+// LZ4 block format, without the frame around it
+std::string Compress(const void* data, size_t size);
+
+// Fails on malformed input or when it doesn't decompress to exactly "size" bytes
+bool Decompress(const void* data, size_t data_size, void* out, size_t size);
+
+}
@@ -0,0 +1,158 @@
+#include "Hash.h"
+
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Hash {
+
+static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t* at)
+{
+    uint64_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const uint8_t* at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * prime2;
+    acc = rotl(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t value)
+{
+    acc ^= round(0, value);
+    return acc * prime1 + prime4;
+}
+
+uint64_t Bytes(const void* data, size_t size, uint64_t seed)
+{
+    auto at = static_cast<const uint8_t*>(data);
+    auto end = at + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+
+        while (at + 32 <= end) {
+            v1 = round(v1, read64(at));
+            v2 = round(v2, read64(at + 8));
+            v3 = round(v3, read64(at + 16));
+            v4 = round(v4, read64(at + 24));
+            at += 32;
+        }
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else {
+        hash = seed + prime5;
+    }
+
+    hash += size;
+
+    while (at + 8 <= end) {
+        hash ^= round(0, read64(at));
+        hash = rotl(hash, 27) * prime1 + prime4;
+        at += 8;
+    }
+
+    if (at + 4 <= end) {
+        hash ^= read32(at) * prime1;
+        hash = rotl(hash, 23) * prime2 + prime3;
+        at += 4;
+    }
+
+    while (at < end) {
+        hash ^= *at * prime5;
+        hash = rotl(hash, 11) * prime1;
+        at++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::optional<uint64_t> File(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) < 0) {
+        close(fd);
+        return {};
+    }
+
+    std::string content(file_stat.st_size, '\0');
+    size_t done = 0;
+    while (done < content.size()) {
+        auto bytes = read(fd, content.data() + done, content.size() - done);
+        if (bytes <= 0) {
+            break;
+        }
+        done += bytes;
+    }
+    close(fd);
+
+    if (done != content.size()) {
+        return {};
+    }
+    return Bytes(content.data(), content.size());
+}
+
+std::string ToHex(uint64_t hash)
+{
+    static constexpr auto digits = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int at = 15; at >= 0; at--) {
+        hex[at] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+std::optional<uint64_t> FromHex(std::string_view hex)
+{
+    uint64_t hash = 0;
+    auto [end, error] = std::from_chars(hex.data(), hex.data() + hex.size(), hash, 16);
+    if (error != std::errc() || end != hex.data() + hex.size() || hex.empty()) {
+        return {};
+    }
+    return hash;
+}
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace Hash {
+
+// XXH64 of a memory block
+uint64_t Bytes(const void* data, size_t size, uint64_t seed = 0);
+
+inline uint64_t String(const std::string& str, uint64_t seed = 0)
+{
+    return Bytes(str.data(), str.size(), seed);
+}
+
+// Hash of the file's content, nothing if it can't be read
+std::optional<uint64_t> File(const std::filesystem::path& path);
+
+inline uint64_t Combine(uint64_t seed, uint64_t value)
+{
+    return Bytes(&value, sizeof(value), seed);
+}
+
+std::string ToHex(uint64_t hash);
+// Nothing if the text isn't a whole hex number
+std::optional<uint64_t> FromHex(std::string_view hex);
+
+}
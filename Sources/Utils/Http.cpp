@@ -0,0 +1,146 @@
+#include "Http.h"
+#include "Socket.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace Http {
+
+static constexpr size_t max_header_size = 64 * 1024;
+static constexpr size_t max_body_size = size_t(1) << 30;
+
+int Message::status() const
+{
+    auto parts = Utils::Split(start_line, " ");
+    if (parts.size() < 2) {
+        return 0;
+    }
+    return atoi(parts[1].c_str());
+}
+
+std::string Message::method() const
+{
+    return start_line.substr(0, start_line.find(' '));
+}
+
+std::string Message::target() const
+{
+    auto parts = Utils::Split(start_line, " ");
+    return parts.size() < 2 ? "" : parts[1];
+}
+
+std::optional<Url> ParseUrl(const std::string& url)
+{
+    static constexpr std::string_view scheme = "http://";
+    if (!url.starts_with(scheme)) {
+        return {};
+    }
+
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto authority = rest.substr(0, slash);
+    auto path = slash == std::string::npos ? "" : rest.substr(slash);
+    while (path.ends_with('/')) {
+        path.pop_back();
+    }
+
+    auto colon = authority.rfind(':');
+    if (colon == std::string::npos) {
+        return Url { .host = authority, .port = "80", .path = path };
+    }
+    return Url { .host = authority.substr(0, colon), .port = authority.substr(colon + 1), .path = path };
+}
+
+bool ReadMessage(int fd, Message& message)
+{
+    std::string data {};
+    size_t header_end = std::string::npos;
+    char buffer[4096];
+
+    while (header_end == std::string::npos) {
+        auto bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes <= 0 || data.size() > max_header_size) {
+            return false;
+        }
+        data.append(buffer, bytes);
+        header_end = data.find("\r\n\r\n");
+    }
+
+    auto lines = Utils::Split(data.substr(0, header_end), "\r\n");
+    if (lines.empty()) {
+        return false;
+    }
+    message.start_line = lines[0];
+    message.headers.clear();
+    for (size_t at = 1; at < lines.size(); at++) {
+        auto colon = lines[at].find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        auto name = lines[at].substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        auto value = lines[at].substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        message.headers[name] = value;
+    }
+
+    message.body = data.substr(header_end + 4);
+    auto length = message.headers.find("content-length");
+    if (length == message.headers.end()) {
+        // without a length the body lasts until the connection is closed
+        if (message.method() == "GET" || message.method() == "HEAD") {
+            return true;
+        }
+        while (true) {
+            auto bytes = read(fd, buffer, sizeof(buffer));
+            if (bytes < 0) {
+                return false;
+            }
+            if (bytes == 0) {
+                return true;
+            }
+            message.body.append(buffer, bytes);
+        }
+    }
+
+    auto size = strtoull(length->second.c_str(), nullptr, 10);
+    if (size > max_body_size) {
+        return false;
+    }
+    if (message.body.size() > size) {
+        message.body.resize(size);
+    }
+    auto received = message.body.size();
+    message.body.resize(size);
+    return Utils::ReadAll(fd, message.body.data() + received, size - received);
+}
+
+bool WriteMessage(int fd, const std::string& head, const std::string& body)
+{
+    auto message_head = head + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    return Socket::SendAll(fd, message_head.data(), message_head.size()) && Socket::SendAll(fd, body.data(), body.size());
+}
+
+std::optional<Message> Request(const Url& url, const std::string& method, const std::string& path, const std::string& body, int timeout)
+{
+    int fd = Socket::Connect(url.host, url.port, timeout);
+    if (fd < 0) {
+        return {};
+    }
+    Socket::SetTimeout(fd, timeout);
+
+    auto head = method + " " + url.path + path + " HTTP/1.1\r\nHost: " + url.host;
+    Message response {};
+    bool done = WriteMessage(fd, head, body) && ReadMessage(fd, response);
+    close(fd);
+
+    if (!done) {
+        return {};
+    }
+    return response;
+}
+
+}
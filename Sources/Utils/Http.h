@@ -0,0 +1,41 @@
+/*
+ * A minimal HTTP/1.1 implementation for the remote object cache:
+ * one request per connection, bodies delimited by Content-Length.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace Http {
+
+struct Message {
+    // "GET /path HTTP/1.1" for requests, "HTTP/1.1 200 OK" for responses
+    std::string start_line {};
+    std::unordered_map<std::string, std::string> headers {};
+    std::string body {};
+
+    int status() const;
+    std::string method() const;
+    std::string target() const;
+};
+
+struct Url {
+    std::string host {};
+    std::string port {};
+    std::string path {};
+};
+
+std::optional<Url> ParseUrl(const std::string& url);
+
+// Reads a whole message, header names are lowercased
+bool ReadMessage(int fd, Message& message);
+// "head" is the start line, optionally followed by header lines
+bool WriteMessage(int fd, const std::string& head, const std::string& body);
+
+// Fails on connection errors, "timeout" applies to connecting and to every read / write
+std::optional<Message> Request(const Url& url, const std::string& method, const std::string& path, const std::string& body, int timeout);
+
+}
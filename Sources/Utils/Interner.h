@@ -0,0 +1,62 @@
+/*
+ * Interner keeps a single copy of every string handed to it for the life of the process.
+ * Each one gets a dense integer id and a view, views are NUL-terminated so they can go
+ * into an argv as they are. Interning a known string takes no allocation.
+ */
+
+#pragma once
+
+#include "Arena.h"
+#include "Lock.h"
+
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
+class Interner {
+public:
+    using Id = uint32_t;
+
+public:
+    static Interner& the()
+    {
+        static auto instance = Interner();
+        return instance;
+    }
+
+    Id intern(std::string_view string)
+    {
+        auto _ = ScopedLocker(m_lock);
+        auto known = m_ids.find(string);
+        if (known != m_ids.end()) {
+            return known->second;
+        }
+
+        auto stored = m_arena.concat(string, std::string_view("", 1)).substr(0, string.size());
+        auto id = static_cast<Id>(m_strings.size());
+        m_strings.push_back(stored);
+        m_ids.emplace(stored, id);
+        return id;
+    }
+
+    std::string_view view(Id id)
+    {
+        auto _ = ScopedLocker(m_lock);
+        return m_strings[id];
+    }
+
+    const char* c_str(Id id) { return view(id).data(); }
+
+    // Interns the string and returns its copy
+    const char* c_str(std::string_view string) { return c_str(intern(string)); }
+
+private:
+    Interner() = default;
+
+private:
+    SpinLock m_lock {};
+    Arena m_arena {};
+    std::unordered_map<std::string_view, Id> m_ids {};
+    std::deque<std::string_view> m_strings {};
+};
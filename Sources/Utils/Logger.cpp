@@ -0,0 +1,206 @@
+#include "Logger.h"
+
+#include "Utils.h"
+
+#include <cstdlib>
+#include <optional>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+
+static constexpr auto StatusInterval = std::chrono::milliseconds(100);
+static constexpr auto IdleStatusInterval = std::chrono::seconds(1);
+static constexpr auto IdleInterval = std::chrono::milliseconds(10);
+static constexpr size_t WriteChunk = 64 * 1024;
+
+static std::string WithoutColors(const std::string& text)
+{
+    std::string plain {};
+    for (size_t at = 0; at < text.size(); at++) {
+        if (text[at] == '\033') {
+            at = text.find('m', at);
+            if (at == std::string::npos) {
+                break;
+            }
+            continue;
+        }
+        plain += text[at];
+    }
+    return plain;
+}
+
+static size_t TerminalWidth()
+{
+    winsize size {};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) < 0 || size.ws_col == 0) {
+        return 80;
+    }
+    return size.ws_col;
+}
+
+Logger& Logger::the()
+{
+    // never destroyed, threads may still log while the process exits
+    static auto instance = new Logger();
+    return *instance;
+}
+
+Logger::Logger()
+{
+    std::atexit([] { Logger::the().flush(); });
+    std::thread([this]() { run(); }).detach();
+}
+
+void Logger::log(Kind kind, std::string&& text)
+{
+    Record record { .kind = kind, .text = std::move(text) };
+    // the writer is behind, records are never dropped
+    while (!m_records.push(std::move(record))) {
+        std::this_thread::yield();
+    }
+}
+
+void Logger::add_job()
+{
+    auto _ = ScopedLocker(m_jobs_lock);
+    if (!m_jobs) {
+        m_jobs_started = std::chrono::steady_clock::now();
+    }
+    m_jobs++;
+}
+
+void Logger::finish_job()
+{
+    auto _ = ScopedLocker(m_jobs_lock);
+    m_finished_jobs++;
+}
+
+void Logger::flush()
+{
+    auto _ = std::lock_guard(m_write_lock);
+    write(true);
+}
+
+void Logger::run()
+{
+    for (;;) {
+        bool written = false;
+        {
+            auto _ = std::lock_guard(m_write_lock);
+            written = write(false);
+        }
+        if (!written) {
+            std::this_thread::sleep_for(IdleInterval);
+        }
+    }
+}
+
+// Returns whether there were any records
+bool Logger::write(bool flushing)
+{
+    std::string out {};
+    auto write_out = [&]() {
+        Utils::WriteAll(STDOUT_FILENO, out.data(), out.size());
+        out.clear();
+    };
+
+    std::optional<bool> terminal {};
+    auto on_terminal = [&]() {
+        if (!terminal) {
+            terminal = !m_verbose && isatty(STDOUT_FILENO);
+        }
+        return *terminal;
+    };
+
+    // a finished line stays above whatever comes next, the jobs after it are counted anew
+    auto end_status = [&]() {
+        if (!m_status_shown) {
+            return;
+        }
+        m_status_shown = false;
+        auto _ = ScopedLocker(m_jobs_lock);
+        if (m_finished_jobs < m_jobs) {
+            out += "\r\033[K";
+            return;
+        }
+        out += "\r\033[K" + status(TerminalWidth() - 1) + "\n";
+        m_jobs = 0;
+        m_finished_jobs = 0;
+        m_last_progress.clear();
+    };
+
+    bool popped = false;
+    bool printed = false;
+    Record record {};
+    while (m_records.pop(record)) {
+        popped = true;
+        if (record.kind == Kind::Progress && on_terminal()) {
+            m_last_progress = std::move(record.text);
+            continue;
+        }
+        end_status();
+        printed = true;
+        out += record.text;
+        out += '\n';
+        if (out.size() >= WriteChunk) {
+            write_out();
+        }
+    }
+
+    // the line is only redrawn every so often, but right away once messages moved it down
+    auto now = std::chrono::steady_clock::now();
+    auto since_drawn = now - m_status_drawn;
+    bool status_due = printed || flushing || (popped && since_drawn >= StatusInterval) || (m_status_shown && since_drawn >= IdleStatusInterval);
+    if (status_due && on_terminal()) {
+        std::string line {};
+        {
+            auto _ = ScopedLocker(m_jobs_lock);
+            line = status(TerminalWidth() - 1);
+        }
+        if (!line.empty()) {
+            out += "\r\033[K" + line;
+            m_status_shown = true;
+            m_status_drawn = now;
+        }
+    }
+
+    // whatever writes to stdout next starts on its own line
+    if (flushing && m_status_shown) {
+        out += '\n';
+        m_status_shown = false;
+    }
+
+    if (!out.empty()) {
+        write_out();
+    }
+    return popped;
+}
+
+// Called with the jobs lock held
+std::string Logger::status(size_t width)
+{
+    auto jobs = m_jobs;
+    auto finished = m_finished_jobs;
+    auto elapsed = std::chrono::steady_clock::now() - m_jobs_started;
+    if (!jobs) {
+        return {};
+    }
+
+    auto line = "[" + std::to_string(finished) + "/" + std::to_string(jobs) + "]";
+    if (finished < jobs) {
+        if (finished) {
+            auto left = std::chrono::duration_cast<std::chrono::seconds>(elapsed * (jobs - finished) / finished).count();
+            auto seconds = std::to_string(left % 60);
+            line += " ETA " + std::to_string(left / 60) + ":" + (seconds.size() < 2 ? "0" : "") + seconds;
+        } else {
+            line += " ETA -:--";
+        }
+    }
+    if (!m_last_progress.empty()) {
+        line += " " + WithoutColors(m_last_progress);
+    }
+    if (line.size() > width) {
+        line.resize(width);
+    }
+    return line;
+}
@@ -1,7 +1,20 @@
+/*
+ * Logger formats records on the calling thread and hands them over through a lock-free
+ * ring buffer to a writer thread, which writes them out in batches.
+ * On a terminal, per-file progress is folded into a single status line ("[12/50] ETA 0:42"),
+ * --verbose or a redirected output get the full log.
+ */
+
 #pragma once
 
 #include "Lock.h"
-#include <iostream>
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <string>
 
 enum class Color {
     Red = 31,
@@ -11,13 +24,83 @@ enum class Color {
     Magenta = 35,
 };
 
-static SpinLock m_lock;
+class Logger {
+public:
+    enum class Kind {
+        // always printed
+        Message,
+        // a unit done without anything to say, only the status line shows it on a terminal
+        Progress,
+        // output of a command, printed as it is
+        Output,
+    };
+
+public:
+    static Logger& the();
+
+    void log(Kind kind, std::string&& text);
+
+    // Progress of the status line, jobs are counted from the first one added after all were finished
+    void add_job();
+    void finish_job();
+
+    void set_verbose(bool verbose) { m_verbose = verbose; }
+
+    // Writes out everything logged so far and erases the status line, before anything else writes to stdout
+    void flush();
+
+private:
+    Logger();
+
+    struct Record {
+        Kind kind {};
+        std::string text {};
+    };
+
+    void run();
+    bool write(bool flushing);
+    std::string status(size_t width);
+
+private:
+    RingBuffer<Record, 4096> m_records {};
+    std::atomic<bool> m_verbose {};
+
+    // Writer, flush() writes from its caller's thread too
+    std::mutex m_write_lock {};
+    bool m_status_shown {};
+    std::string m_last_progress {};
+    std::chrono::steady_clock::time_point m_status_drawn {};
+
+    SpinLock m_jobs_lock {};
+    size_t m_jobs {};
+    size_t m_finished_jobs {};
+    std::chrono::steady_clock::time_point m_jobs_started {};
+};
+
+template <class... Types>
+std::string FormatLog(Color color, Types... args)
+{
+    std::ostringstream line {};
+    line << "\033[1;" << static_cast<uint32_t>(color) << "m";
+    ((line << args << " "), ...);
+    line << "\033[0m";
+    return line.str();
+}
 
 template <class... Types>
 void Log(Color color, Types... args)
 {
-    auto _ = ScopedLocker(m_lock);
-    std::cout << "\033[1;" << static_cast<uint32_t>(color) << "m";
-    auto print_args = { (std::cout << args << " ", 0)... };
-    std::cout << "\033[0m\n";
+    Logger::the().log(Logger::Kind::Message, FormatLog(color, args...));
+}
+
+// For a finished unit without warnings, it's left out of the log on a terminal
+template <class... Types>
+void LogProgress(Color color, Types... args)
+{
+    Logger::the().log(Logger::Kind::Progress, FormatLog(color, args...));
+}
+
+inline void LogOutput(const std::string& output)
+{
+    Logger::the().log(Logger::Kind::Output, std::string(output));
 }
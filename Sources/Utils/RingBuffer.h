@@ -0,0 +1,79 @@
+/*
+ * RingBuffer is a bounded lock-free queue for any number of producers and consumers.
+ * Every cell carries a sequence number telling whose turn it is, so a push or a pop
+ * only contends on a single compare-exchange.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+template <typename ValueType, size_t Capacity>
+class RingBuffer {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+
+public:
+    RingBuffer()
+        : m_cells(std::make_unique<Cell[]>(Capacity))
+    {
+        for (size_t at = 0; at < Capacity; at++) {
+            m_cells[at].sequence.store(at, std::memory_order_relaxed);
+        }
+    }
+
+    // False if the buffer is full, the value is left untouched then
+    bool push(ValueType&& value)
+    {
+        auto position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = m_cells[position & (Capacity - 1)];
+            auto turn = static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(position);
+            if (turn == 0) {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (turn < 0) {
+                return false;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(ValueType& value)
+    {
+        auto position = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = m_cells[position & (Capacity - 1)];
+            auto turn = static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(position + 1);
+            if (turn == 0) {
+                if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + Capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (turn < 0) {
+                return false;
+            } else {
+                position = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence {};
+        ValueType value {};
+    };
+
+private:
+    std::unique_ptr<Cell[]> m_cells {};
+    // apart from each other, producers and the consumer don't share a cache line
+    alignas(64) std::atomic<size_t> m_tail {};
+    alignas(64) std::atomic<size_t> m_head {};
+};
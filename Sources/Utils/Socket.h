@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Socket {
+
+// Connected TCP socket or -1, "timeout" bounds the connection only
+int Connect(const std::string& host, const std::string& port, int timeout);
+
+// Listening TCP socket bound to an IPv4 address or -1
+int Listen(const std::string& address, int port);
+
+// Bounds every following read / write
+void SetTimeout(int fd, int timeout);
+
+// A peer closing the connection mustn't kill the process with SIGPIPE
+bool SendAll(int fd, const void* data, size_t size);
+
+}
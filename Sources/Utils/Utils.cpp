@@ -1,6 +1,8 @@
 #include "Utils.h"
 
+#include <cerrno>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
 namespace Utils {
@@ -34,4 +36,38 @@ std::vector<std::string> Split(const std::string& str, const std::string& del)
     return result;
 }
 
+bool ReadAll(int fd, void* data, size_t size)
+{
+    auto at = static_cast<char*>(data);
+    while (size) {
+        auto bytes = read(fd, at, size);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return false;
+        }
+        at += bytes;
+        size -= bytes;
+    }
+    return true;
+}
+
+bool WriteAll(int fd, const void* data, size_t size)
+{
+    auto at = static_cast<const char*>(data);
+    while (size) {
+        auto bytes = write(fd, at, size);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return false;
+        }
+        at += bytes;
+        size -= bytes;
+    }
+    return true;
+}
+
 }
\ No newline at end of file
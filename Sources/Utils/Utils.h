@@ -7,4 +7,8 @@ namespace Utils {
 
 std::vector<std::string> Split(const std::string& str, const std::string& del);
 
+// Loop over partial reads / writes, return false if the descriptor was closed or failed
+bool ReadAll(int fd, void* data, size_t size);
+bool WriteAll(int fd, const void* data, size_t size);
+
 }
@@ -0,0 +1,259 @@
+#include "Watcher.h"
+#include "../Cache/ObjectCache.h"
+#include "../Config.h"
+#include "../Context.h"
+#include "../Executor/Executor.h"
+#include "../Finder/GlobCache.h"
+#include "../Finder/StatCache.h"
+#include "../Utils/Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static constexpr auto watch_mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+static constexpr auto structure_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+static constexpr auto build_poll_ms = 10;
+static constexpr auto default_debounce_ms = 100;
+
+static std::filesystem::path normalize_directory(const std::filesystem::path& directory)
+{
+    auto normal = directory.lexically_normal();
+    if (normal.empty()) {
+        return ".";
+    }
+    if (!normal.has_filename() && normal.has_relative_path()) {
+        return normal.parent_path();
+    }
+    return normal;
+}
+
+Watcher::Watcher(Context* root)
+    : m_root(root)
+{
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        Log(Color::Red, "can't initialize inotify");
+        exit(1);
+    }
+    collect_contexts(root);
+}
+
+Watcher::~Watcher()
+{
+    close(m_inotify_fd);
+}
+
+void Watcher::run()
+{
+    const auto debounce_ms = Config::the().int_flag("debounce", default_debounce_ms);
+
+    for (;;) {
+        watch_directories();
+        Log(Color::Magenta, "Watching for changes...");
+        Logger::the().flush();
+
+        while (!read_events(-1)) { }
+
+        bool cancelled;
+        do {
+            // edits that arrive in a burst are built together
+            while (read_events(debounce_ms)) { }
+
+            if (m_configuration_changed) {
+                restart();
+            }
+
+            apply_changes();
+            rerun();
+
+            // a newer edit makes the running build stale, it's cancelled and started over
+            cancelled = false;
+            while (!done()) {
+                if (read_events(build_poll_ms) && !cancelled) {
+                    Executor::the().cancel();
+                    cancelled = true;
+                }
+            }
+        } while (cancelled);
+
+        GlobCache::the().save();
+
+        if (m_root->failed()) {
+            Log(Color::Red, "Build failed");
+        }
+    }
+}
+
+void Watcher::collect_contexts(Context* context)
+{
+    if (std::find(m_contexts.begin(), m_contexts.end(), context) != m_contexts.end()) {
+        return;
+    }
+    m_contexts.push_back(context);
+    for (auto child : context->children()) {
+        collect_contexts(child);
+    }
+}
+
+void Watcher::watch_directories()
+{
+    m_known_files.clear();
+
+    for (auto context : m_contexts) {
+        add_watch(context->cwd());
+
+        for (auto& [pattern, files] : context->m_found_sources) {
+            for (auto& file : files) {
+                m_known_files.insert(file.lexically_normal().string());
+                add_watch(file.parent_path());
+            }
+        }
+
+        for (auto& [file, includes] : context->m_include_graph) {
+            m_known_files.insert(file);
+            add_watch(std::filesystem::path(file).parent_path());
+        }
+    }
+}
+
+void Watcher::add_watch(const std::filesystem::path& directory)
+{
+    auto normal = normalize_directory(directory);
+    if (!m_watched_directories.insert(normal.string()).second) {
+        return;
+    }
+
+    int wd = inotify_add_watch(m_inotify_fd, normal.c_str(), watch_mask);
+    if (wd < 0) {
+        Log(Color::Yellow, "can't watch", normal.string());
+        return;
+    }
+    m_watches[wd] = normal;
+}
+
+bool Watcher::read_events(int timeout_ms)
+{
+    pollfd descriptor {};
+    descriptor.fd = m_inotify_fd;
+    descriptor.events = POLLIN;
+    if (poll(&descriptor, 1, timeout_ms) <= 0) {
+        return false;
+    }
+
+    bool relevant = false;
+    alignas(inotify_event) char buffer[4096];
+
+    while (true) {
+        auto length = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char* at = buffer; at < buffer + length;) {
+            auto event = reinterpret_cast<inotify_event*>(at);
+            at += sizeof(inotify_event) + event->len;
+
+            // changes were lost, nothing in memory can be trusted anymore
+            if (event->mask & IN_Q_OVERFLOW) {
+                m_configuration_changed = true;
+                relevant = true;
+                continue;
+            }
+
+            auto directory = m_watches.find(event->wd);
+            if (!event->len || directory == m_watches.end()) {
+                continue;
+            }
+
+            // build outputs, editor swap and backup files
+            std::string name = event->name;
+            if (name == "MacaBuild" || name.starts_with('.') || name.ends_with('~')) {
+                continue;
+            }
+
+            auto path = (directory->second / name).lexically_normal();
+            bool known = m_known_files.contains(path.string());
+
+            if (name.ends_with(".maca")) {
+                m_configuration_changed = true;
+            } else if (event->mask & structure_mask) {
+                // a new file may match a Src pattern or shadow a header, a removed one may have been used
+                bool appeared = event->mask & (IN_CREATE | IN_MOVED_TO);
+                if ((event->mask & IN_ISDIR) || (appeared && !known && path.has_extension()) || (!appeared && known)) {
+                    m_structure_changed = true;
+                } else if (!known) {
+                    continue;
+                }
+            } else if (!known) {
+                continue;
+            }
+
+            m_changed_files.push_back(std::move(path));
+            relevant = true;
+        }
+    }
+
+    return relevant;
+}
+
+void Watcher::apply_changes()
+{
+    for (auto context : m_contexts) {
+        if (m_structure_changed) {
+            context->invalidate_sources();
+            continue;
+        }
+        for (auto& file : m_changed_files) {
+            context->invalidate(file);
+        }
+    }
+
+    m_changed_files.clear();
+    m_structure_changed = false;
+}
+
+void Watcher::rerun()
+{
+    Config::the().update_timestamp();
+    StatCache::the().clear();
+    GlobCache::the().revalidate();
+    auto generation = Executor::the().generation();
+
+    // states are reset before any thread is started, as parents poll their children's states
+    for (auto context : m_contexts) {
+        if (context->operation() == Context::Operation::Build && context->m_state != Context::State::ParseError) {
+            context->m_state = Context::State::Parsed;
+            context->m_done = false;
+            context->m_generation = generation;
+        }
+    }
+
+    for (auto context : m_contexts) {
+        if (context->operation() == Context::Operation::Build) {
+            context->rerun();
+        }
+    }
+}
+
+bool Watcher::done() const
+{
+    return std::all_of(m_contexts.begin(), m_contexts.end(), [](Context* context) {
+        return context->done();
+    });
+}
+
+void Watcher::restart()
+{
+    // contexts can't be reparsed in place, the process starts over with the same arguments.
+    // A .maca file that doesn't parse fails the new root context, which keeps watching until it's fixed.
+    Log(Color::Magenta, "Configuration changed, restarting");
+    ObjectCache::the().flush();
+    GlobCache::the().save();
+    Logger::the().flush();
+    execv("/proc/self/exe", Config::the().argv());
+    Log(Color::Red, "can't restart:", strerror(errno));
+    exit(1);
+}
@@ -0,0 +1,49 @@
+/*
+ * Watcher keeps the parsed contexts, their sources and include graphs in memory
+ * and rebuilds them whenever inotify reports a change in one of the watched folders.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Context;
+
+class Watcher {
+public:
+    explicit Watcher(Context* root);
+    ~Watcher();
+
+    [[noreturn]] void run();
+
+    // Building blocks of run(), also used by the build server to keep its contexts up to date
+    void watch_directories();
+    bool read_events(int timeout_ms);
+    void apply_changes();
+    void rerun();
+    bool done() const;
+    bool configuration_changed() const { return m_configuration_changed; }
+
+private:
+    void collect_contexts(Context* context);
+    void add_watch(const std::filesystem::path& directory);
+
+    [[noreturn]] void restart();
+
+private:
+    Context* m_root {};
+    std::vector<Context*> m_contexts {};
+
+    int m_inotify_fd { -1 };
+    std::unordered_map<int, std::filesystem::path> m_watches {};
+    std::unordered_set<std::string> m_watched_directories {};
+    std::unordered_set<std::string> m_known_files {};
+
+    std::vector<std::filesystem::path> m_changed_files {};
+    bool m_structure_changed {};
+    bool m_configuration_changed {};
+};
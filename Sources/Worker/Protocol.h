@@ -0,0 +1,152 @@
+/*
+ * Protocol spoken between the dispatcher of Macabuilder and MacaWorker daemons.
+ * A connection carries a single request and its response, integers are sent in host byte order.
+ */
+
+#pragma once
+
+#include "../Utils/Socket.h"
+#include "../Utils/Utils.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace WorkerProtocol {
+
+static constexpr uint32_t Magic = 0x5743414d;
+static constexpr uint64_t MaxStringSize = uint64_t(1) << 30;
+
+enum class Request : uint32_t {
+    Slots,
+    Compile,
+};
+
+struct CompileJob {
+    // the compiler followed by its arguments
+    std::vector<std::string> command {};
+    // paths are relative to the working directory of the compiler
+    std::string output {};
+    std::vector<std::pair<std::string, std::string>> files {};
+};
+
+struct CompileResult {
+    int32_t status {};
+    std::string std_out {};
+    std::string std_err {};
+    std::string object {};
+};
+
+class Writer {
+public:
+    inline void u32(uint32_t value) { m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    inline void u64(uint64_t value) { m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    inline void string(const std::string& value)
+    {
+        u64(value.size());
+        m_buffer.append(value);
+    }
+
+    inline bool send(int fd) const { return Socket::SendAll(fd, m_buffer.data(), m_buffer.size()); }
+
+private:
+    std::string m_buffer {};
+};
+
+class Reader {
+public:
+    explicit Reader(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    inline bool ok() const { return m_ok; }
+
+    inline uint32_t u32()
+    {
+        uint32_t value {};
+        m_ok = m_ok && Utils::ReadAll(m_fd, &value, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t u64()
+    {
+        uint64_t value {};
+        m_ok = m_ok && Utils::ReadAll(m_fd, &value, sizeof(value));
+        return value;
+    }
+
+    inline std::string string()
+    {
+        auto size = u64();
+        if (!m_ok || size > MaxStringSize) {
+            m_ok = false;
+            return {};
+        }
+        std::string value(size, '\0');
+        m_ok = Utils::ReadAll(m_fd, value.data(), size);
+        return value;
+    }
+
+private:
+    int m_fd {};
+    bool m_ok { true };
+};
+
+inline bool SendJob(int fd, const CompileJob& job)
+{
+    Writer writer {};
+    writer.u32(Magic);
+    writer.u32(static_cast<uint32_t>(Request::Compile));
+    writer.u32(job.command.size());
+    for (auto& arg : job.command) {
+        writer.string(arg);
+    }
+    writer.string(job.output);
+    writer.u32(job.files.size());
+    for (auto& [path, content] : job.files) {
+        writer.string(path);
+        writer.string(content);
+    }
+    return writer.send(fd);
+}
+
+// The request header is read by the worker beforehand
+inline bool ReceiveJob(Reader& reader, CompileJob& job)
+{
+    auto args = reader.u32();
+    for (uint32_t at = 0; at < args && reader.ok(); at++) {
+        job.command.push_back(reader.string());
+    }
+    job.output = reader.string();
+    auto files = reader.u32();
+    for (uint32_t at = 0; at < files && reader.ok(); at++) {
+        auto path = reader.string();
+        auto content = reader.string();
+        job.files.emplace_back(std::move(path), std::move(content));
+    }
+    return reader.ok() && !job.command.empty();
+}
+
+inline bool SendResult(int fd, const CompileResult& result)
+{
+    Writer writer {};
+    writer.u32(static_cast<uint32_t>(result.status));
+    writer.string(result.std_out);
+    writer.string(result.std_err);
+    writer.string(result.object);
+    return writer.send(fd);
+}
+
+inline bool ReceiveResult(int fd, CompileResult& result)
+{
+    Reader reader(fd);
+    result.status = static_cast<int32_t>(reader.u32());
+    result.std_out = reader.string();
+    result.std_err = reader.string();
+    result.object = reader.string();
+    return reader.ok();
+}
+
+}
@@ -0,0 +1,240 @@
+/*
+ * MacaWorker compiles units sent by Macabuilder dispatchers on another machine.
+ * The sources and headers of a unit are shipped along with it and recreated
+ * in a temporary folder, the compiler itself comes from this machine.
+ *
+ * Usage: MacaWorker [port] [slots] [address]
+ */
+
+#include "../Utils/Logger.h"
+#include "../Utils/Socket.h"
+#include "Protocol.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <poll.h>
+#include <semaphore>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace WorkerProtocol;
+
+static uint32_t s_slots {};
+static std::counting_semaphore<>* s_free_slots {};
+
+// Paths may climb out of the working directory with "..", which is nested deep enough to keep them in the job folder
+static bool WorkingDepth(const CompileJob& job, size_t& depth)
+{
+    auto climbs = [&](const std::string& path) {
+        auto normal = std::filesystem::path(path).lexically_normal();
+        if (normal.empty() || normal.is_absolute()) {
+            return false;
+        }
+        size_t ups = 0;
+        for (auto& part : normal) {
+            if (part != "..") {
+                break;
+            }
+            ups++;
+        }
+        depth = std::max(depth, ups);
+        return true;
+    };
+
+    if (!climbs(job.output)) {
+        return false;
+    }
+    return std::all_of(job.files.begin(), job.files.end(), [&](auto& file) { return climbs(file.first); });
+}
+
+static bool WriteFile(const std::filesystem::path& path, const std::string& content)
+{
+    std::error_code error {};
+    std::filesystem::create_directories(path.parent_path(), error);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = Utils::WriteAll(fd, content.data(), content.size());
+    close(fd);
+    return written;
+}
+
+static CompileResult Compile(const CompileJob& job, const std::filesystem::path& cwd)
+{
+    CompileResult result {};
+    int out_fds[2], err_fds[2];
+    if (pipe2(out_fds, O_CLOEXEC) < 0 || pipe2(err_fds, O_CLOEXEC) < 0) {
+        result.status = 1;
+        result.std_err = "MacaWorker: can't create pipes";
+        return result;
+    }
+
+    std::vector<char*> args {};
+    for (auto& arg : job.command) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    auto pid = fork();
+    if (pid < 0) {
+        for (auto fd : { out_fds[0], out_fds[1], err_fds[0], err_fds[1] }) {
+            close(fd);
+        }
+        result.status = 1;
+        result.std_err = "MacaWorker: can't start the compiler";
+        return result;
+    }
+    if (pid == 0) {
+        dup2(out_fds[1], STDOUT_FILENO);
+        dup2(err_fds[1], STDERR_FILENO);
+        if (chdir(cwd.c_str()) == 0) {
+            execvp(args[0], args.data());
+        }
+        _exit(127);
+    }
+    close(out_fds[1]);
+    close(err_fds[1]);
+
+    // both pipes are drained together, so a chatty compiler can't block on a full one
+    pollfd descriptors[2] {};
+    descriptors[0].fd = out_fds[0];
+    descriptors[1].fd = err_fds[0];
+    descriptors[0].events = descriptors[1].events = POLLIN;
+    std::string* outputs[] = { &result.std_out, &result.std_err };
+    size_t open_pipes = 2;
+    char buffer[4096];
+    while (open_pipes && poll(descriptors, 2, -1) > 0) {
+        for (size_t at = 0; at < 2; at++) {
+            if (descriptors[at].fd < 0 || !descriptors[at].revents) {
+                continue;
+            }
+            auto bytes = read(descriptors[at].fd, buffer, sizeof(buffer));
+            if (bytes > 0) {
+                outputs[at]->append(buffer, bytes);
+            } else {
+                close(descriptors[at].fd);
+                descriptors[at].fd = -1;
+                open_pipes--;
+            }
+        }
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    result.status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    return result;
+}
+
+static void Handle(int connection)
+{
+    Reader reader(connection);
+    auto magic = reader.u32();
+    auto request = static_cast<Request>(reader.u32());
+    if (!reader.ok() || magic != Magic) {
+        close(connection);
+        return;
+    }
+
+    if (request == Request::Slots) {
+        Writer writer {};
+        writer.u32(s_slots);
+        writer.send(connection);
+        close(connection);
+        return;
+    }
+
+    CompileJob job {};
+    size_t depth = 0;
+    if (request != Request::Compile || !ReceiveJob(reader, job) || !WorkingDepth(job, depth)) {
+        close(connection);
+        return;
+    }
+
+    char folder_template[] = "/tmp/macaworker.XXXXXX";
+    if (!mkdtemp(folder_template)) {
+        close(connection);
+        return;
+    }
+    std::filesystem::path folder = folder_template;
+    auto cwd = folder;
+    for (size_t level = 0; level < depth; level++) {
+        cwd /= "w";
+    }
+
+    CompileResult result {};
+    bool prepared = std::all_of(job.files.begin(), job.files.end(), [&](auto& file) {
+        return WriteFile(cwd / std::filesystem::path(file.first).lexically_normal(), file.second);
+    });
+
+    std::error_code error {};
+    auto output = cwd / std::filesystem::path(job.output).lexically_normal();
+    std::filesystem::create_directories(output.parent_path(), error);
+
+    if (!prepared) {
+        result.status = 1;
+        result.std_err = "MacaWorker: can't write the sources";
+    } else {
+        s_free_slots->acquire();
+        result = Compile(job, cwd);
+        s_free_slots->release();
+
+        if (!result.status) {
+            int fd = open(output.c_str(), O_RDONLY | O_CLOEXEC);
+            auto size = fd < 0 ? -1 : lseek(fd, 0, SEEK_END);
+            if (size >= 0) {
+                result.object.resize(size);
+            }
+            if (size < 0 || pread(fd, result.object.data(), size, 0) != size) {
+                result.status = 1;
+                result.std_err += "MacaWorker: the compiler produced no object";
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    std::filesystem::remove_all(folder, error);
+
+    if (result.status) {
+        Log(Color::Red, "Failed:", job.output);
+    } else {
+        Log(Color::Green, "Compiled:", job.output);
+    }
+    Logger::the().flush();
+    SendResult(connection, result);
+    close(connection);
+}
+
+int main(int argc, char** argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : 8585;
+    s_slots = argc > 2 ? atoi(argv[2]) : std::max(1U, std::thread::hardware_concurrency());
+    std::string address = argc > 3 ? argv[3] : "127.0.0.1";
+
+    signal(SIGPIPE, SIG_IGN);
+    s_free_slots = new std::counting_semaphore<>(s_slots);
+
+    int server = Socket::Listen(address, port);
+    if (server < 0) {
+        Log(Color::Red, "can't listen on", address + ":" + std::to_string(port) + ":", strerror(errno));
+        return 1;
+    }
+
+    Log(Color::Magenta, "Compiling with", s_slots, "slots at", address + ":" + std::to_string(port));
+    Logger::the().flush();
+
+    for (;;) {
+        int connection = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            continue;
+        }
+        std::thread(Handle, connection).detach();
+    }
+}
@@ -1,8 +1,13 @@
+#include "Cache/ObjectCache.h"
 #include "Config.h"
 #include "Context.h"
 #include "Executor/Executor.h"
 #include "Finder/Finder.h"
+#include "Finder/GlobCache.h"
+#include "Server/Client.h"
+#include "Server/Server.h"
 #include "Utils/Logger.h"
+#include "Watcher/Watcher.h"
 
 #include <thread>
 
@@ -10,6 +15,35 @@ int main(int argc, char** argv)
 {
     Config::the().process_arguments(argc, argv);
 
+    auto mode = Config::the().mode();
+    if (mode == Config::Mode::Cache) {
+        if (Config::the().arguments()[1] != "stats") {
+            Log(Color::Red, "unknown cache command:", Config::the().arguments()[1]);
+            exit(1);
+        }
+        ObjectCache::the().print_stats();
+        return 0;
+    }
+
+    if (mode == Config::Mode::Analyze && Config::the().arguments()[1] != "headers") {
+        Log(Color::Red, "unknown analysis:", Config::the().arguments()[1]);
+        exit(1);
+    }
+
+    if (mode == Config::Mode::Generate && Config::the().arguments().size() == 2) {
+        auto& generator = Config::the().arguments()[1];
+        if (generator != "cmake" && generator != "ninja") {
+            Log(Color::Red, "unknown generator:", generator);
+            exit(1);
+        }
+    }
+
+    if (mode != Config::Mode::Server && mode != Config::Mode::Watch) {
+        if (auto status = Client::forward(argc, argv)) {
+            return *status;
+        }
+    }
+
     auto maca_files = Finder::FindRootMacaFiles();
 
     if (maca_files.size() > 1) {
@@ -22,6 +56,11 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    if (mode == Config::Mode::Server) {
+        Executor::the().run();
+        Server(maca_files.front()).run();
+    }
+
     auto context = Context(maca_files.front(), Context::Operation::Build, {}, true);
     context.run();
 
@@ -31,5 +70,14 @@ int main(int argc, char** argv)
         std::this_thread::yield();
     }
 
+    if (Config::the().mode() == Config::Mode::Watch) {
+        Watcher(&context).run();
+    }
+
+    Executor::the().stop();
+    Executor::the().await();
+    ObjectCache::the().flush();
+    GlobCache::the().save();
+
     return 0;
 }